@@ -25,7 +25,54 @@
 #define HTTP_PORT	80
 #define HTTP_PATH	"/mailnotifier.php"
 
+#define HTTP_RETRIES		2 // Try sending the report again this many times if the connection fails while GPRS is still up, before giving up and power cycling
+#define HTTP_RETRY_DELAY	1000 // First retry is after 1 - 2 seconds, doubles each time (ms)
+#define HTTP_TIMEOUT		30000 // Give up on the first attempt after this long (ms)
+#define HTTP_RETRY_TIMEOUT	15000 // Shorter for retries, GPRS is already known to be up (ms)
+#define HTTP_DEADLINE		105000 // Don't start a retry that could still be going this long after power on, the MCU cuts power at 120 seconds (ms)
+#define DELTA_REPORTS		1 // Leave out fields that haven't changed since the last report the server acknowledged, the server fills them in
+#define HTTP_INSTANCES		2 // Number of HTTP requests that can be in flight at once (tracking uploads can overlap a slow one)
+
+#define FAST_SHUTDOWN		1 // Tell the MCU the result as soon as the report is done, it cuts power after a short grace period instead of waiting for the network disconnect
+
+#define SMS_FALLBACK			0 // Send a compact SMS to SMS_FALLBACK_NUM if GPRS fails (not in tracking mode), set the number before turning this on
+#define SMS_FALLBACK_NUM		"+440000000000" // Number of the SMS gateway that forwards to smsgateway.php
+#define SMS_FALLBACK_MINSIGNAL	5 // Don't bother trying GPRS if the signal level (0 - 31) is below this
+
+#define MAILCOMM_BAUD		MAIL_COMM_BAUD_38400 // Baud rate to switch to after the first exchange with the MCU, MAIL_COMM_BAUD_9600 to stay at 9600
+#define MAILCOMM_LINKTEST	0 // Measure the error rate of each baud rate instead of doing the normal stuff
+
+// Tracking either leaves the GPS on and records a point every TRACK_SAMPLE_INTERVAL, or duty cycles it and only gets one point per report, not both
+#define GPS_DUTY_CYCLE	0 // Only turn the GPS on for long enough to get a fix before each tracking report, instead of leaving it on the whole time (needs TRACK_SAMPLE_INTERVAL 0)
+#define GPS_LEAD_TIME	30 // Turn the GPS on this long before each report (seconds), if the tracking interval is shorter than this it just stays on
+#define GPS_MAX_HDOP	2.5 // Fix must be at least this good before the GPS is turned off again
+#define GPS_MIN_SATS	5
+
+#define TRACK_SAMPLE_INTERVAL	5 // Record a track point this often while the GPS has a good fix (seconds), 0 = one point per report
+#define TRACK_SIMPLIFY			1 // Drop points that are on a (nearly) straight line between the ones either side
+#define TRACK_TOLERANCE			15.0f // How far the simplified track can be from the dropped points (metres)
+#define TRACK_POINTS_MAX		64 // Points waiting to be uploaded, oldest are lost when full
+#define TRACK_UPLOAD_MAX		16 // Max points in each report, the rest wait for the next one
+#define TRACK_SPILL_POINTS		8 // While GPRS is down, move points to flash in groups of this many
+#define TRACK_QUEUE_SEGMENTS	8 // Flash queue files
+#define TRACK_QUEUE_SEG_POINTS	64 // Points in each file (16 bytes each)
+
+#if GPS_DUTY_CYCLE && TRACK_SAMPLE_INTERVAL
+#error "GPS_DUTY_CYCLE turns the GPS off after the first good fix, there'd be nothing to sample. Set TRACK_SAMPLE_INTERVAL to 0 or turn off GPS_DUTY_CYCLE"
+#endif
+
+#define BME280_PROFILE	BME280_PROFILE_WEATHER // Oversampling and filter settings, see bme280.h
+
+// Drop the CPU frequency and allow sleep while only waiting for network events
+// Off by default: bytes lost on UART1 while waking haven't been measured yet, and an unsolicited status push from the MCU can turn up at any time
+#define FREQ_GOVERNOR	0
+#define FREQ_HIGH		PM_SYS_FREQ_13M // For building JSON, parsing NMEA, socket I/O and MCU comms
+#define FREQ_LOW		PM_SYS_FREQ_32K
+
 #define DEBUG 1 // Disable all *_DBG() and PRINTD() messages
+#define LOG_RING		0 // Record debug messages in RAM and only format them when they're drained (after the report has been sent), instead of printing them straight away
+#define LOG_RING_SIZE	64 // Number of messages to keep
+#define LOG_REPORT		8 // Add the last few messages to reports that needed retries (needs LOG_RING), 0 = never
 
 #define DEBUG_SMS 1
 #define DEBUG_GSM 1
@@ -34,5 +81,7 @@
 #define DEBUG_GPRS 1
 #define DEBUG_SMTP 1
 #define DEBUG_HTTP 1
+#define DEBUG_NMEA 0 // Dump all received NMEA data
+#define DEBUG_UART 0 // Hex dump everything from the MCU
 
 #endif /* CONFIG_H_ */
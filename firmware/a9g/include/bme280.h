@@ -9,11 +9,21 @@
 #ifndef __BME280_H_
 #define __BME280_H_
 
+// Oversampling and IIR filter settings, from the datasheet recommended modes
+#define BME280_PROFILE_WEATHER	0 // x1 / x1 / x1, filter off (~9ms)
+#define BME280_PROFILE_HUMIDITY	1 // x1 / skipped / x1, filter off (~7ms)
+#define BME280_PROFILE_INDOOR	2 // x2 / x16 / x1, filter x16 (~41ms)
+#define BME280_PROFILE_MAX		3 // x16 / x16 / x16, filter off (~113ms, what it used to be)
+
+typedef struct {
+	int32_t temperature; // 0.01 DegC
+	uint32_t pressure; // Pa, Q24.8
+	uint32_t humidity; // %RH, Q22.10
+} bme280_data_t;
+
 void bme280_init(void);
 void bme280_startConvertion(void);
 uint8_t bme280_status(void);
-int32_t bme280_readTemperature(void);
-int32_t bme280_readHumidity(void);
-int32_t bme280_readPressure(void);
+uint8_t bme280_read(bme280_data_t* data);
 
 #endif
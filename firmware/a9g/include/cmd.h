@@ -0,0 +1,55 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#ifndef __CMD_H_
+#define __CMD_H_
+
+// Server response: {"result":"ok","cmd":{"ti":30,"bal":1,"enc":1,"hb":24,"rs":1}}
+// ti = Tracking interval (seconds)
+// bal = Check balance on the next wake
+// enc = Payload encoding, see SETTINGS_ENCODING_*
+// hb = Heartbeat interval (hours), 0 to disable
+// rs = Server doesn't have our delta snapshot, send everything next time
+#define CMD_TRACKINTERVAL	0
+#define CMD_BALANCE			1
+#define CMD_ENCODING		2
+#define CMD_HEARTBEAT		3
+#define CMD_RESYNC			4
+#define CMD_COUNT			5
+
+#define CMD_STR_MAXLEN		8
+
+typedef struct {
+	uint8_t started;
+	uint8_t depth;
+	uint16_t objMask; // Bit set for each depth that is an object, cleared for arrays
+	uint8_t expectKey;
+	uint8_t inCmd;
+	uint8_t inString;
+	uint8_t escape;
+	uint8_t inNumber;
+	uint8_t numNeg;
+	uint8_t numFrac; // Past the decimal point
+	uint8_t numBad; // Has an exponent or too many digits, ignored
+	int32_t num;
+	char str[CMD_STR_MAXLEN + 1];
+	uint8_t strLen;
+	char key[CMD_STR_MAXLEN + 1];
+	uint8_t resultOk;
+	uint8_t resultBad;
+	uint8_t have; // Bit set for each CMD_* received
+	int32_t values[CMD_COUNT];
+} cmd_t;
+
+void cmd_begin(cmd_t* ctx);
+void cmd_feed(cmd_t* ctx, const char* data, uint32_t len);
+uint8_t cmd_done(cmd_t* ctx);
+uint8_t cmd_resultOk(cmd_t* ctx);
+uint8_t cmd_get(cmd_t* ctx, uint8_t cmd, int32_t* value);
+
+#endif
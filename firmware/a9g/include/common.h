@@ -23,6 +23,7 @@
 #include "../config.h"
 
 #include "debug.h"
+#include "logring.h"
 
 #include "buffer.h"
 #include "gps_parse.h"
@@ -40,6 +41,7 @@
 #include "api_audio.h"
 #include "api_hal_i2c.h"
 #include "api_sms.h"
+#include "api_fs.h"
 
 #include "cJSON.h"
 
@@ -48,10 +50,17 @@
 #include "gprs.h"
 #include "sms.h"
 #include "gsm.h"
+#include "cmd.h"
 #include "http.h"
 #include "bme280.h"
 #include "mailcomm.h"
 #include "mailcomm_defs.h"
 #include "led.h"
+#include "freq.h"
+#include "telemetry.h"
+#include "evtqueue.h"
+#include "settings.h"
+#include "delta.h"
+#include "track.h"
 
 #endif
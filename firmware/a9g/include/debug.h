@@ -9,25 +9,34 @@
 #ifndef __DEBUG_H_
 #define __DEBUG_H_
 
+// Disabled categories compile to nothing, the if() is always false
+#if LOG_RING
+#define LOG_OUT(tag, fmt, ...)	logring_record("(" tag ")"fmt, ## __VA_ARGS__)
+#define LOG_TRACE(fmt, ...)		logring_record("(DBG)"fmt, ## __VA_ARGS__)
+#else
+#define LOG_OUT(tag, fmt, ...)	printf(":(%u)(" tag ")"fmt, millis(), ## __VA_ARGS__)
+#define LOG_TRACE(fmt, ...)		Trace(1, ":(%u)(DBG)"fmt, millis(), ## __VA_ARGS__)
+#endif
+
 #define PRINTD(fmt, ...) \
-            do { if (DEBUG) Trace(1, ":(%u)(DBG)"fmt, millis(), ## __VA_ARGS__); } while (0)
+            do { if (DEBUG) LOG_TRACE(fmt, ## __VA_ARGS__); } while (0)
 
 #define DBG_SMS(fmt, ...) \
-            do { if (DEBUG && DEBUG_SMS) printf(":(%u)(SMS)"fmt, millis(), ## __VA_ARGS__); } while (0)
+            do { if (DEBUG && DEBUG_SMS) LOG_OUT("SMS", fmt, ## __VA_ARGS__); } while (0)
 
 #define DBG_GSM(fmt, ...) \
-            do { if (DEBUG && DEBUG_GSM) printf(":(%u)(GSM)"fmt, millis(), ## __VA_ARGS__); } while (0)
+            do { if (DEBUG && DEBUG_GSM) LOG_OUT("GSM", fmt, ## __VA_ARGS__); } while (0)
 
 #define DBG_GPRS(fmt, ...) \
-            do { if (DEBUG && DEBUG_GPRS) printf(":(%u)(GPRS)"fmt, millis(), ## __VA_ARGS__); } while (0)
+            do { if (DEBUG && DEBUG_GPRS) LOG_OUT("GPRS", fmt, ## __VA_ARGS__); } while (0)
 				
 #define DBG_MAIL(fmt, ...) \
-            do { if (DEBUG && DEBUG_MAIL) printf(":(%u)(MAIL)"fmt, millis(), ## __VA_ARGS__); } while (0)
+            do { if (DEBUG && DEBUG_MAIL) LOG_OUT("MAIL", fmt, ## __VA_ARGS__); } while (0)
 
 #define DBG_SMTP(fmt, ...) \
-            do { if (DEBUG && DEBUG_SMTP) printf(":(%u)(SMTP)"fmt, millis(), ## __VA_ARGS__); } while (0)
+            do { if (DEBUG && DEBUG_SMTP) LOG_OUT("SMTP", fmt, ## __VA_ARGS__); } while (0)
 
 #define DBG_HTTP(fmt, ...) \
-            do { if (DEBUG && DEBUG_HTTP) printf(":(%u)(HTTP)"fmt, millis(), ## __VA_ARGS__); } while (0)
+            do { if (DEBUG && DEBUG_HTTP) LOG_OUT("HTTP", fmt, ## __VA_ARGS__); } while (0)
 
 #endif
@@ -0,0 +1,40 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#ifndef __DELTA_H_
+#define __DELTA_H_
+
+#define DELTA_FILE		"/snapshot.dat"
+#define DELTA_VERSION	2
+#define DELTA_SEQ_BLOCK	16 // Sequence numbers reserved with each flash write
+
+// Groups of fields that rarely change, left out of the report if they're the same as the last one the server acknowledged
+#define DELTA_FIRMWARE	0
+#define DELTA_SIM		1 // ICCID and number
+#define DELTA_IP		2
+#define DELTA_BALANCE	3
+#define DELTA_SATS		4 // GPS and BDS fix/satellite counts
+#define DELTA_COUNT		5
+
+#define DELTA_HASH_INIT	2166136261UL
+
+// One of these for each report that's in flight
+typedef struct {
+	uint16_t base; // Snapshot the server should merge this report over, 0 = full report
+	uint16_t seq; // This report, becomes the new snapshot once acknowledged
+	uint32_t hash[DELTA_COUNT];
+} delta_t;
+
+void delta_init(void);
+void delta_begin(delta_t* delta);
+uint32_t delta_hash(uint32_t hash, const void* data, uint32_t len);
+uint8_t delta_changed(delta_t* delta, uint8_t group, uint32_t hash);
+void delta_acked(delta_t* delta);
+void delta_resync(void);
+
+#endif
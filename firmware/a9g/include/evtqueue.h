@@ -0,0 +1,21 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#ifndef __EVTQUEUE_H_
+#define __EVTQUEUE_H_
+
+#define EVTQUEUE_SIZE		32 // Must be a power of 2
+#define EVTQUEUE_RESERVED	8 // Slots that NMEA can't use
+#define EVTQUEUE_BUCKETS	9 // Latency histogram buckets: 0ms, 1ms, 2-3ms, 4-7ms ... 64-127ms, 128ms+
+
+bool evtqueue_push(API_Event_t* event, bool* wake);
+API_Event_t* evtqueue_pop(void);
+uint32_t evtqueue_latency(uint8_t bucket);
+uint32_t evtqueue_dropped(void);
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#ifndef __FREQ_H_
+#define __FREQ_H_
+
+// Things that need the CPU running fast, anything else is just waiting for network events
+#define FREQ_PHASE_BOOT		0
+#define FREQ_PHASE_JSON		1
+#define FREQ_PHASE_NMEA		2
+#define FREQ_PHASE_SOCKET	3
+#define FREQ_PHASE_LINK		4
+#define FREQ_PHASE_GPS		5 // NMEA streams in on UART2 the whole time the GPS is on
+#define FREQ_PHASE_COUNT	6
+
+void freq_init(void);
+void freq_begin(uint8_t phase);
+void freq_end(uint8_t phase);
+millis_t freq_phaseTime(uint8_t phase);
+millis_t freq_highTime(void);
+millis_t freq_lowTime(void);
+
+#endif
@@ -12,6 +12,8 @@
 void gprs_init(void);
 void gprs_connect(void);
 void gprs_disconnect(void);
+uint8_t gprs_isAttached(void);
+uint8_t gprs_isActive(void);
 void gprs_event(API_Event_t* pEvent);
 
 #endif
@@ -12,6 +12,8 @@
 void gsm_init(void);
 void gsm_connect(void);
 void gsm_disconnect(void);
+millis_t gsm_registerTime(void);
+uint8_t gsm_usedSavedPlmn(void);
 void gsm_event(API_Event_t* pEvent);
 
 #endif
@@ -9,13 +9,28 @@
 #ifndef __HTTP_H_
 #define __HTTP_H_
 
-void http_begin(void);
-int http_host(char* server, uint32_t port);
+#define HTTP_VERDICT_PENDING	0
+#define HTTP_VERDICT_OK			1
+#define HTTP_VERDICT_FAIL		2
+
+typedef struct {
+	uint8_t state;
+	uint8_t spaces;
+	uint8_t lineLen;
+	uint16_t status;
+	uint8_t verdict;
+	cmd_t cmd;
+} http_resp_t;
+
+void http_begin(uint8_t id);
+int http_host(uint8_t id, char* server, uint32_t port);
 int http_headerBegin(char* buff, char* reqType, char* host, char* uri);
 int http_headerAdd(char* buff, char* key, char* value);
 int http_headerEnd(char* buff);
 int http_send(int fd, void* data, uint32_t len);
 int http_read(int fd, void* data, uint32_t len);
 bool http_close(int fd);
+void http_responseBegin(http_resp_t* resp);
+uint8_t http_responseFeed(http_resp_t* resp, const char* data, uint32_t len);
 
 #endif
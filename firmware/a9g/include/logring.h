@@ -0,0 +1,20 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#ifndef __LOGRING_H_
+#define __LOGRING_H_
+
+// Debug messages are recorded as the format string pointer plus raw arguments, text formatting is only done when drained.
+// Format strings must be string literals (they are with the DBG_*() macros), only the first %s argument is copied.
+
+void logring_init(void);
+void logring_record(const char* fmt, ...);
+void logring_drain(void);
+uint8_t logring_get(uint16_t age, char* buff, uint32_t len);
+
+#endif
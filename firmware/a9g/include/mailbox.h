@@ -36,12 +36,19 @@
 #define MAILBOX_EVT_HTTP_RECV	API_EVENT_ID_MAX + 23
 #define MAILBOX_EVT_HTTP_CLOSE	API_EVENT_ID_MAX + 24
 #define MAILBOX_EVT_HTTP_ERROR	API_EVENT_ID_MAX + 25
+#define MAILBOX_EVT_MAILCOMM_ERROR	API_EVENT_ID_MAX + 26
+#define MAILBOX_EVT_MAILCOMM_LINKTEST	API_EVENT_ID_MAX + 27
+#define MAILBOX_EVENT_GPRS_ATTACHED		API_EVENT_ID_MAX + 28
+#define MAILBOX_EVT_QUEUE		API_EVENT_ID_MAX + 29
 
 #define MAILBOX_EVT_	API_EVENT_ID_MAX + 19
 
+#define TIME_VALID		1577836800 // 2020-01-01, anything before this means the network hasn't set the clock yet
+
 typedef uint32_t millis_t;
 
 void mailbox_eventDispatch(API_Event_t* event);
+bool mailbox_forwardEvent(API_Event_t* event);
 
 void mailbox_task(void *pData);
 void mail_sendEvent(uint32_t id, uint32_t param1, uint32_t param2, void* pParam1, void* pParam2);
@@ -13,6 +13,9 @@ void mailcomm_init(void);
 void mailcomm_request(void);
 void mailcomm_keepalive(void);
 void mailcomm_poweroff(uint8_t status);
+void mailcomm_negotiate(void);
+void mailcomm_heartbeat(uint8_t hours);
+void mailcomm_linkTest(void);
 uint8_t* mailcomm_getBuff(void);
 void mailcomm_update(void);
 void mailcomm_event(API_Event_t* pEvent);
@@ -0,0 +1,35 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#ifndef __SETTINGS_H_
+#define __SETTINGS_H_
+
+#define SETTINGS_FILE		"/mailbox.cfg"
+#define SETTINGS_VERSION	2
+
+#define SETTINGS_ENCODING_FULL		0
+#define SETTINGS_ENCODING_COMPACT	1 // Leave out the diagnostic stuff (firmware, power, timing etc)
+
+// Things the server can change with the command block in its response and other stuff to remember between wakes, kept in A9G flash
+typedef struct {
+	uint8_t version;
+	uint8_t encoding;
+	uint8_t heartbeat; // Hours (1 - 31), 0 = disabled
+	uint8_t balForce; // Check balance on the next wake
+	uint16_t trackInterval; // Seconds
+	uint8_t plmn[6]; // Network we last registered on, all 0 = none
+} settings_t;
+
+extern settings_t settings;
+
+uint8_t settings_readFile(const char* path, void* data, uint32_t len);
+uint8_t settings_writeFile(const char* path, void* data, uint32_t len);
+void settings_init(void);
+void settings_save(void);
+
+#endif
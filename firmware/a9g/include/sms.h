@@ -13,7 +13,8 @@ typedef void (*SMSList_Callback_t)(SMS_Message_Info_t* messageInfo);
 typedef void (*SMSNewMessage_Callback_t)(SMS_Encode_Type_t encodeType, uint32_t contentLength, uint8_t* header, uint8_t* content);
 
 void sms_init(void);
-uint8_t sms_clearAll(void);
+uint8_t sms_storageNearlyFull(void);
+uint8_t sms_clearStep(uint8_t count);
 void sms_listCallback(SMSList_Callback_t callback);
 void sms_newMessageCallback(SMSNewMessage_Callback_t callback);
 void sms_info(void);
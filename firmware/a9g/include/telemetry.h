@@ -0,0 +1,25 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#ifndef __TELEMETRY_H_
+#define __TELEMETRY_H_
+
+#define TELEMETRY_TASK_MAIN		0
+#define TELEMETRY_TASK_MAILBOX	1
+#define TELEMETRY_TASK_COUNT	2
+
+void telemetry_taskStart(uint8_t task);
+uint32_t telemetry_stackPeak(uint8_t task);
+uint32_t telemetry_stackSize(uint8_t task);
+void telemetry_heapSample(void);
+uint32_t telemetry_heapPeak(void);
+uint32_t telemetry_heapTotal(void);
+void telemetry_mallocFailed(void);
+uint32_t telemetry_mallocFails(void);
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#ifndef __TRACK_H_
+#define __TRACK_H_
+
+#define TRACK_WINDOW	16 // Max points that can be skipped in a row before one has to be kept anyway
+#define TRACK_QUEUE_FILE	"/trkq%u.dat"
+
+typedef struct {
+	uint32_t id;
+	int32_t lat; // Degrees * 100000 (about 1m)
+	int32_t lon;
+	uint32_t time; // Unix time, survives a reboot while waiting in the flash queue, 0 = clock wasn't set yet
+} track_point_t;
+
+void track_init(void);
+void track_begin(void);
+void track_add(float lat, float lon);
+void track_flush(void);
+void track_end(void);
+const track_point_t* track_batch(uint8_t owner, uint8_t* count);
+void track_release(uint8_t owner);
+void track_ack(uint32_t id);
+uint32_t track_in(void);
+uint32_t track_out(void);
+uint16_t track_queued(void);
+uint32_t track_drained(void);
+uint32_t track_lost(void);
+
+#endif
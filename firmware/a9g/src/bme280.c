@@ -8,226 +8,282 @@
 
 #include "common.h"
 
-// Calibration registers are read everytime a sensor is read, maybe read calibration regs once and store in memory?
-
-// TODO
 // Sometimes the I2C bus glitches out and the SDA line is stuck low. I'm not sure if its the BME280 or the A9G. When this happens I2C read/writes will fail with error 2 (I2C_ERROR_RESOURCE_BUSY)
-// Maybe I2C_Close() then I2C_Init() fixes it?
 // It might be caused by GSM interference
 // Maybe stronger pullup resistors will fix it, they're 10k at the mo
+// Re-initialising the I2C peripheral and trying again seems to get things going
+// That only resets the A9G side though, if the BME280 itself is holding SDA low then SCL would need clocking by hand (up to 9 times then a STOP) to free it, which isn't done here
 
 #define ADDR	0x76
 
-#define REG_CALI_DIG_T1	0x88
-#define REG_CALI_DIG_T2	0x8A
-#define REG_CALI_DIG_T3	0x8C
-
-#define REG_CALI_DIG_P1	0x8E
-#define REG_CALI_DIG_P2	0x90
-#define REG_CALI_DIG_P3	0x92
-#define REG_CALI_DIG_P4	0x94
-#define REG_CALI_DIG_P5	0x96
-#define REG_CALI_DIG_P6	0x98
-#define REG_CALI_DIG_P7	0x9A
-#define REG_CALI_DIG_P8	0x9C
-#define REG_CALI_DIG_P9	0x9E
-
-#define REG_CALI_DIG_H1	0xA1
-#define REG_CALI_DIG_H2	0xE1
-#define REG_CALI_DIG_H3	0xE3
-#define REG_CALI_DIG_H4	0xE4
-#define REG_CALI_DIG_H5	0xE5
-#define REG_CALI_DIG_H6	0xE7
+#define REG_CALIB00		0x88 // 0x88 - 0xA1
+#define REG_CALIB26		0xE1 // 0xE1 - 0xE7
+#define CALIB00_LEN		26
+#define CALIB26_LEN		7
 
+#define REG_CTRL_HUM	0xF2
 #define REG_STATUS		0xF3
 #define REG_CTRL		0xF4
-#define REG_CTRL_HUM	0xF2
-#define REG_TEMPERATURE	0xFA
-#define REG_PRESSURE	0xF7
-#define REG_HUMIDITY	0xFD
+#define REG_CONFIG		0xF5
+#define REG_DATA		0xF7 // 0xF7 - 0xFE: press_msb, press_lsb, press_xlsb, temp_msb, temp_lsb, temp_xlsb, hum_msb, hum_lsb
+#define DATA_LEN		8
+
+#define OVERSAMPLE_SKIP	0
+#define OVERSAMPLE_X1	1
+#define OVERSAMPLE_X2	2
+#define OVERSAMPLE_X4	3
+#define OVERSAMPLE_X8	4
+#define OVERSAMPLE_X16	5
+
+#define FILTER_OFF		0
+#define FILTER_X16		4
 
-#define OVERSAMPLE_X16_TEMPERATURE	0b10100000
-#define OVERSAMPLE_X16_PRESSURE		0b00010100
-#define OVERSAMPLE_X16_HUMIDITY		0b00000101
 #define MODE_SLEEP	0x00
 #define MODE_FORCE	0x01
 #define MODE_NORMAL	0x03
 
-static int32_t t_fine;
-
-static void i2cWrite(void* buff, uint8_t len)
-{
-	I2C_Error_t res = I2C_Transmit(I2C2, ADDR, buff, len, I2C_DEFAULT_TIME_OUT);
-	if(res != I2C_ERROR_NONE)
-		PRINTD("I2C2 write err: %d", res);
-}
-
-static void i2cRead(void* buff, uint8_t len)
+#define CTRL_MEAS(t, p)	(((t)<<5) | ((p)<<2))
+
+#define I2C_RETRIES		2
+
+typedef struct {
+	uint8_t ctrlHum;
+	uint8_t ctrlMeas;
+	uint8_t config;
+} profile_t;
+
+// Indexed by BME280_PROFILE_*
+static const profile_t profiles[] = {
+	{OVERSAMPLE_X1,		CTRL_MEAS(OVERSAMPLE_X1, OVERSAMPLE_X1),	FILTER_OFF<<2},
+	{OVERSAMPLE_X1,		CTRL_MEAS(OVERSAMPLE_X1, OVERSAMPLE_SKIP),	FILTER_OFF<<2},
+	{OVERSAMPLE_X1,		CTRL_MEAS(OVERSAMPLE_X2, OVERSAMPLE_X16),	FILTER_X16<<2},
+	{OVERSAMPLE_X16,	CTRL_MEAS(OVERSAMPLE_X16, OVERSAMPLE_X16),	FILTER_OFF<<2}
+};
+
+typedef struct {
+	uint16_t T1;
+	int16_t T2;
+	int16_t T3;
+	uint16_t P1;
+	int16_t P2;
+	int16_t P3;
+	int16_t P4;
+	int16_t P5;
+	int16_t P6;
+	int16_t P7;
+	int16_t P8;
+	int16_t P9;
+	uint8_t H1;
+	int16_t H2;
+	uint8_t H3;
+	int16_t H4;
+	int16_t H5;
+	int8_t H6;
+} calib_t;
+
+static calib_t calib;
+static uint8_t calibValid;
+
+static void i2cInit(void)
 {
-	I2C_Error_t res = I2C_Receive(I2C2, ADDR, buff, len, I2C_DEFAULT_TIME_OUT);
-	if(res != I2C_ERROR_NONE)
-		PRINTD("I2C2 read err: %d", res);
+	I2C_Config_t i2cConfig;
+	i2cConfig.freq = I2C_FREQ_100K;
+	I2C_Init(I2C2, i2cConfig);
 }
 
-static uint8_t read8(uint8_t reg)
+// Resets the peripheral, doesn't free a slave holding SDA
+static void i2cRecover(void)
 {
-	i2cWrite(&reg, 1);
-	i2cRead(&reg, 1);
-	return reg;
+	PRINTD("I2C2 recover");
+	I2C_Close(I2C2);
+	i2cInit();
 }
 
-static uint16_t read16(uint8_t reg)
+static uint8_t readRegs(uint8_t reg, uint8_t* buff, uint8_t len)
 {
-	uint8_t data[2];
-	i2cWrite(&reg, 1);
-	i2cRead(data, 2);
-	return (data[0]<<8) | data[1];
-}
+	for(uint8_t i=0;i<I2C_RETRIES;i++)
+	{
+		I2C_Error_t res = I2C_Transmit(I2C2, ADDR, &reg, 1, I2C_DEFAULT_TIME_OUT);
+		if(res == I2C_ERROR_NONE)
+			res = I2C_Receive(I2C2, ADDR, buff, len, I2C_DEFAULT_TIME_OUT);
+		if(res == I2C_ERROR_NONE)
+			return 1;
 
-static uint16_t read16_LE(uint8_t reg)
-{
-	uint16_t temp = read16(reg);
-	return (temp>>8) | (temp<<8);
+		PRINTD("I2C2 read err: %d", res);
+		i2cRecover();
+	}
+	return 0;
 }
 
-static int16_t readS16_LE(uint8_t reg)
+static uint8_t writeReg(uint8_t reg, uint8_t val)
 {
-	return (int16_t)read16_LE(reg);
-}
+	uint8_t data[2] = {reg, val};
+	for(uint8_t i=0;i<I2C_RETRIES;i++)
+	{
+		I2C_Error_t res = I2C_Transmit(I2C2, ADDR, data, 2, I2C_DEFAULT_TIME_OUT);
+		if(res == I2C_ERROR_NONE)
+			return 1;
 
-static uint32_t read24(uint8_t reg)
-{
-	uint8_t data[3];
-	i2cWrite(&reg, 1);
-	i2cRead(data, 3);
-	return (data[0]<<16) | (data[1]<<8) | data[2];
+		PRINTD("I2C2 write err: %d", res);
+		i2cRecover();
+	}
+	return 0;
 }
 
-void bme280_init()
+static uint8_t readCalib(void)
 {
-	uint8_t data[2];
-
-//	data[0] = 0xE0;
-//	data[1] = 0xB6;
-//	i2cWrite(data, 2);
-//	OS_Sleep(300);
+	uint8_t c[CALIB00_LEN];
+	uint8_t h[CALIB26_LEN];
 
-	data[0] = REG_CTRL_HUM;
-	data[1] = OVERSAMPLE_X16_HUMIDITY;
-	i2cWrite(data, 2);
-
-	data[0] = REG_CTRL;
-	data[1] = OVERSAMPLE_X16_TEMPERATURE | OVERSAMPLE_X16_PRESSURE | MODE_SLEEP;
-	i2cWrite(data, 2);
-}
+	if(!readRegs(REG_CALIB00, c, sizeof(c)) || !readRegs(REG_CALIB26, h, sizeof(h)))
+		return 0;
 
-void bme280_startConvertion()
-{
-	uint8_t data[2];
-	data[0] = REG_CTRL;
-	data[1] = OVERSAMPLE_X16_TEMPERATURE | OVERSAMPLE_X16_PRESSURE | MODE_FORCE;
-	i2cWrite(data, 2);
+	calib.T1 = (c[1]<<8) | c[0];
+	calib.T2 = (int16_t)((c[3]<<8) | c[2]);
+	calib.T3 = (int16_t)((c[5]<<8) | c[4]);
+	calib.P1 = (c[7]<<8) | c[6];
+	calib.P2 = (int16_t)((c[9]<<8) | c[8]);
+	calib.P3 = (int16_t)((c[11]<<8) | c[10]);
+	calib.P4 = (int16_t)((c[13]<<8) | c[12]);
+	calib.P5 = (int16_t)((c[15]<<8) | c[14]);
+	calib.P6 = (int16_t)((c[17]<<8) | c[16]);
+	calib.P7 = (int16_t)((c[19]<<8) | c[18]);
+	calib.P8 = (int16_t)((c[21]<<8) | c[20]);
+	calib.P9 = (int16_t)((c[23]<<8) | c[22]);
+	calib.H1 = c[25];
+	calib.H2 = (int16_t)((h[1]<<8) | h[0]);
+	calib.H3 = h[2];
+	calib.H4 = (int16_t)(((int8_t)h[3] * 16) | (h[4] & 0x0F));
+	calib.H5 = (int16_t)(((int8_t)h[5] * 16) | (h[4] >> 4));
+	calib.H6 = (int8_t)h[6];
+
+	return 1;
 }
 
-uint8_t bme280_status()
-{
-	return read8(REG_STATUS) & (0x08 | 0x01);
-}
+// Compensation formulas are from the BME280 datasheet
 
-int32_t bme280_readTemperature()
+static int32_t compensateTemperature(int32_t adc_T, int32_t* t_fine)
 {
-	int32_t adc_T = read24(REG_TEMPERATURE);
-	if(adc_T == 0x800000)
-		return 0;
-
-	uint16_t dig_T1 = read16_LE(REG_CALI_DIG_T1);
-	int16_t dig_T2 = readS16_LE(REG_CALI_DIG_T2);
-	int16_t dig_T3 = readS16_LE(REG_CALI_DIG_T3);
-
-	adc_T >>= 4;
-
-	int32_t var1 = ((((adc_T >> 3) - ((int32_t)dig_T1 << 1))) * ((int32_t)dig_T2)) >> 11;
-	int32_t var2 = (((((adc_T >> 4) - ((int32_t)dig_T1)) * ((adc_T >> 4) - ((int32_t)dig_T1))) >> 12) * ((int32_t)dig_T3)) >> 14;
+	int32_t var1 = ((((adc_T >> 3) - ((int32_t)calib.T1 << 1))) * ((int32_t)calib.T2)) >> 11;
+	int32_t var2 = (((((adc_T >> 4) - ((int32_t)calib.T1)) * ((adc_T >> 4) - ((int32_t)calib.T1))) >> 12) * ((int32_t)calib.T3)) >> 14;
 
-	t_fine = var1 + var2;
+	*t_fine = var1 + var2;
 
-	int32_t T = (t_fine * 5 + 128) >> 8;
-	return T;
+	return (*t_fine * 5 + 128) >> 8;
 }
 
-int32_t bme280_readPressure()
+static uint32_t compensatePressure(int32_t adc_P, int32_t t_fine)
 {
-	int32_t adc_P = read24(REG_PRESSURE);
-	if (adc_P == 0x800000)
-		return 0;
-
-	uint16_t dig_P1 = read16_LE(REG_CALI_DIG_P1);
-	int16_t dig_P2 = readS16_LE(REG_CALI_DIG_P2);
-	int16_t dig_P3 = readS16_LE(REG_CALI_DIG_P3);
-	int16_t dig_P4 = readS16_LE(REG_CALI_DIG_P4);
-	int16_t dig_P5 = readS16_LE(REG_CALI_DIG_P5);
-	int16_t dig_P6 = readS16_LE(REG_CALI_DIG_P6);
-	int16_t dig_P7 = readS16_LE(REG_CALI_DIG_P7);
-	int16_t dig_P8 = readS16_LE(REG_CALI_DIG_P8);
-	int16_t dig_P9 = readS16_LE(REG_CALI_DIG_P9);
-
-	adc_P >>= 4;
-
 	int64_t var1 = ((int64_t)t_fine) - 128000;
-	int64_t var2 = var1 * var1 * (int64_t)dig_P6;
-	var2 = var2 + ((var1 * (int64_t)dig_P5) << 17);
-	var2 = var2 + (((int64_t)dig_P4) << 35);
-	var1 = ((var1 * var1 * (int64_t)dig_P3) >> 8) + ((var1 * (int64_t)dig_P2) << 12);
-	var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)dig_P1) >> 33;
+	int64_t var2 = var1 * var1 * (int64_t)calib.P6;
+	var2 = var2 + ((var1 * (int64_t)calib.P5) << 17);
+	var2 = var2 + (((int64_t)calib.P4) << 35);
+	var1 = ((var1 * var1 * (int64_t)calib.P3) >> 8) + ((var1 * (int64_t)calib.P2) << 12);
+	var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)calib.P1) >> 33;
 
 	if(var1 == 0)
 		return 0; // avoid exception caused by division by zero
 
 	int64_t p = 1048576 - adc_P;
 	p = (((p << 31) - var2) * 3125) / var1;
-	var1 = (((int64_t)dig_P9) * (p >> 13) * (p >> 13)) >> 25;
-	var2 = (((int64_t)dig_P8) * p) >> 19;
+	var1 = (((int64_t)calib.P9) * (p >> 13) * (p >> 13)) >> 25;
+	var2 = (((int64_t)calib.P8) * p) >> 19;
 
-	p = ((p + var1 + var2) >> 8) + (((int64_t)dig_P7) << 4);
+	p = ((p + var1 + var2) >> 8) + (((int64_t)calib.P7) << 4);
 
-	return (int32_t)p;
+	return (uint32_t)p;
 }
 
-int32_t bme280_readHumidity()
+static uint32_t compensateHumidity(int32_t adc_H, int32_t t_fine)
 {
-	int32_t adc_H = read16(REG_HUMIDITY);
-	if (adc_H == 0x8000)
-		return 0;
-
-	uint8_t dig_H1 = read8(REG_CALI_DIG_H1);
-	int16_t dig_H2 = readS16_LE(REG_CALI_DIG_H2);
-	uint8_t dig_H3 = read8(REG_CALI_DIG_H3);
-	int16_t dig_H4 = (read8(REG_CALI_DIG_H4) << 4) | (read8(REG_CALI_DIG_H4 + 1) & 0xF);
-	int16_t dig_H5 = (read8(REG_CALI_DIG_H5 + 1) << 4) | (read8(REG_CALI_DIG_H5) >> 4);
-	int8_t dig_H6 = (int8_t)read8(REG_CALI_DIG_H6);
-
 	int32_t v_x1_u32r = (t_fine - ((int32_t)76800));
 
 	v_x1_u32r =
-		(((((adc_H << 14) - (((int32_t)dig_H4) << 20) -
-		(((int32_t)dig_H5) * v_x1_u32r)) +
+		(((((adc_H << 14) - (((int32_t)calib.H4) << 20) -
+		(((int32_t)calib.H5) * v_x1_u32r)) +
 		((int32_t)16384)) >>
 		15) *
-		(((((((v_x1_u32r * ((int32_t)dig_H6)) >> 10) *
-		(((v_x1_u32r * ((int32_t)dig_H3)) >> 11) +
+		(((((((v_x1_u32r * ((int32_t)calib.H6)) >> 10) *
+		(((v_x1_u32r * ((int32_t)calib.H3)) >> 11) +
 		((int32_t)32768))) >>
 		10) +
 		((int32_t)2097152)) *
-		((int32_t)dig_H2) +
+		((int32_t)calib.H2) +
 		8192) >>
 		14));
 
 	v_x1_u32r =
 		(v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) *
-		((int32_t)dig_H1)) >>
+		((int32_t)calib.H1)) >>
 		4));
 
 	v_x1_u32r = (v_x1_u32r < 0) ? 0 : v_x1_u32r;
 	v_x1_u32r = (v_x1_u32r > 419430400) ? 419430400 : v_x1_u32r;
-	return (int32_t)(v_x1_u32r >> 12);
+	return (uint32_t)(v_x1_u32r >> 12);
+}
+
+void bme280_init()
+{
+	i2cInit();
+
+//	writeReg(0xE0, 0xB6);
+//	OS_Sleep(300);
+
+	// Calibration values never change, read them once instead of every time a sensor is read
+	calibValid = readCalib();
+	if(!calibValid)
+		PRINTD("BME280 calibration read failed");
+
+	// ctrl_hum only takes effect after writing ctrl_meas
+	// config can only be written in sleep mode
+	writeReg(REG_CONFIG, profiles[BME280_PROFILE].config);
+	writeReg(REG_CTRL_HUM, profiles[BME280_PROFILE].ctrlHum);
+	writeReg(REG_CTRL, profiles[BME280_PROFILE].ctrlMeas | MODE_SLEEP);
+}
+
+void bme280_startConvertion()
+{
+	writeReg(REG_CTRL, profiles[BME280_PROFILE].ctrlMeas | MODE_FORCE);
+}
+
+uint8_t bme280_status()
+{
+	uint8_t status;
+	if(!readRegs(REG_STATUS, &status, 1))
+		return 0xFF;
+	return status & (0x08 | 0x01);
+}
+
+uint8_t bme280_read(bme280_data_t* data)
+{
+	memset(data, 0, sizeof(bme280_data_t));
+
+	if(!calibValid)
+	{
+		calibValid = readCalib();
+		if(!calibValid)
+			return 0;
+	}
+
+	// All measurements in one go so they're all from the same conversion
+	uint8_t raw[DATA_LEN];
+	if(!readRegs(REG_DATA, raw, sizeof(raw)))
+		return 0;
+
+	int32_t adc_P = ((uint32_t)raw[0]<<12) | ((uint32_t)raw[1]<<4) | (raw[2]>>4);
+	int32_t adc_T = ((uint32_t)raw[3]<<12) | ((uint32_t)raw[4]<<4) | (raw[5]>>4);
+	int32_t adc_H = ((uint32_t)raw[6]<<8) | raw[7];
+
+	// 0x80000 and 0x8000 are what skipped measurements read as
+	if(adc_T == 0x80000)
+		return 0;
+
+	int32_t t_fine;
+	data->temperature = compensateTemperature(adc_T, &t_fine);
+	if(adc_P != 0x80000)
+		data->pressure = compensatePressure(adc_P, t_fine);
+	if(adc_H != 0x8000)
+		data->humidity = compensateHumidity(adc_H, t_fine);
+
+	return 1;
 }
@@ -0,0 +1,210 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#include "common.h"
+
+// Incremental JSON scanner for the server response
+// The response arrives in chunks of any size so this works one character at a time and only keeps what it needs,
+// anything it doesn't understand is skipped over.
+// Everything is kept in a cmd_t so each HTTP instance can parse its own response.
+
+#define STR_MAXLEN		CMD_STR_MAXLEN
+#define MAX_DEPTH		16
+
+static const char* const cmdKeys[CMD_COUNT] = {
+	"ti",
+	"bal",
+	"enc",
+	"hb",
+	"rs"
+};
+
+static void stringEnd(cmd_t* ctx)
+{
+	ctx->str[(ctx->strLen > STR_MAXLEN) ? 0 : ctx->strLen] = '\0'; // Too long to be anything we're interested in
+
+	if(ctx->expectKey)
+		strcpy(ctx->key, ctx->str);
+	else if(ctx->depth == 1 && strcmp(ctx->key, "result") == 0)
+	{
+		ctx->resultOk = (strcmp(ctx->str, "ok") == 0);
+		ctx->resultBad = !ctx->resultOk;
+	}
+}
+
+static void numberEnd(cmd_t* ctx)
+{
+	ctx->inNumber = 0;
+	if(!ctx->inCmd || ctx->depth != 2 || ctx->numBad)
+		return;
+
+	for(uint8_t i=0;i<CMD_COUNT;i++)
+	{
+		if(strcmp(ctx->key, cmdKeys[i]) == 0)
+		{
+			ctx->values[i] = ctx->numNeg ? -ctx->num : ctx->num;
+			ctx->have |= (1<<i);
+			break;
+		}
+	}
+}
+
+static void parse(cmd_t* ctx, char c)
+{
+	if(!ctx->started)
+	{
+		// Skip anything before the JSON (HTTP headers)
+		if(c != '{')
+			return;
+		ctx->started = 1;
+	}
+	else if(ctx->depth == 0) // Finished
+		return;
+
+	if(ctx->inString)
+	{
+		if(ctx->escape)
+			ctx->escape = 0;
+		else if(c == '\\')
+		{
+			ctx->escape = 1;
+			return;
+		}
+		else if(c == '"')
+		{
+			ctx->inString = 0;
+			stringEnd(ctx);
+			return;
+		}
+
+		if(ctx->strLen <= STR_MAXLEN)
+			ctx->str[ctx->strLen++] = c;
+		return;
+	}
+
+	if(ctx->inNumber)
+	{
+		if(c >= '0' && c <= '9')
+		{
+			if(ctx->numFrac)
+				return;
+			if(ctx->num < 100000000)
+				ctx->num = (ctx->num * 10) + (c - '0');
+			else // Too big to be anything sensible, ignored instead of wrapping
+				ctx->numBad = 1;
+			return;
+		}
+		else if(c == '.') // Only the integer part is kept
+		{
+			ctx->numFrac = 1;
+			return;
+		}
+		else if(c == 'e' || c == 'E' || (ctx->numBad && (c == '+' || c == '-'))) // Exponents aren't worth supporting, the value is ignored
+		{
+			ctx->numBad = 1;
+			return;
+		}
+		numberEnd(ctx);
+	}
+
+	switch(c)
+	{
+		case '"':
+			ctx->inString = 1;
+			ctx->strLen = 0;
+			break;
+		case '{':
+		case '[':
+			if(ctx->depth == 1 && c == '{' && strcmp(ctx->key, "cmd") == 0)
+				ctx->inCmd = 1;
+			if(ctx->depth < MAX_DEPTH)
+			{
+				if(c == '{')
+					ctx->objMask |= (1<<ctx->depth);
+				else
+					ctx->objMask &= ~(1<<ctx->depth);
+			}
+			ctx->depth++;
+			ctx->expectKey = (c == '{');
+			ctx->key[0] = '\0';
+			break;
+		case '}':
+		case ']':
+			ctx->depth--;
+			if(ctx->depth < 2)
+				ctx->inCmd = 0;
+			ctx->expectKey = 0;
+			break;
+		case ',':
+			ctx->expectKey = (ctx->depth > 0 && ctx->depth <= MAX_DEPTH && (ctx->objMask & (1<<(ctx->depth - 1))));
+			break;
+		case ':':
+			ctx->expectKey = 0;
+			break;
+		case '-':
+			ctx->numNeg = 1;
+			ctx->numFrac = 0;
+			ctx->numBad = 0;
+			ctx->num = 0;
+			ctx->inNumber = 1;
+			break;
+		default:
+			if(c >= '0' && c <= '9')
+			{
+				ctx->numNeg = 0;
+				ctx->numFrac = 0;
+				ctx->numBad = 0;
+				ctx->num = c - '0';
+				ctx->inNumber = 1;
+			}
+			// Anything else (true, false, null, whitespace) is ignored
+			break;
+	}
+}
+
+void cmd_begin(cmd_t* ctx)
+{
+	ctx->started = 0;
+	ctx->depth = 0;
+	ctx->objMask = 0;
+	ctx->expectKey = 0;
+	ctx->inCmd = 0;
+	ctx->inString = 0;
+	ctx->escape = 0;
+	ctx->inNumber = 0;
+	ctx->strLen = 0;
+	ctx->key[0] = '\0';
+	ctx->resultOk = 0;
+	ctx->resultBad = 0;
+	ctx->have = 0;
+}
+
+void cmd_feed(cmd_t* ctx, const char* data, uint32_t len)
+{
+	for(uint32_t i=0;i<len;i++)
+		parse(ctx, data[i]);
+}
+
+uint8_t cmd_done(cmd_t* ctx)
+{
+	// A bad result is final, otherwise wait for the end of the object since the commands come after the result
+	return (ctx->started && (ctx->depth == 0 || ctx->resultBad));
+}
+
+uint8_t cmd_resultOk(cmd_t* ctx)
+{
+	return ctx->resultOk;
+}
+
+uint8_t cmd_get(cmd_t* ctx, uint8_t cmd, int32_t* value)
+{
+	if(!(ctx->have & (1<<cmd)))
+		return 0;
+	*value = ctx->values[cmd];
+	return 1;
+}
@@ -0,0 +1,103 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#include "common.h"
+
+// Delta reports
+// The server keeps the last few reports it got, keyed by sequence number. Each report says which one it should be merged over
+// (the last one the server acknowledged) and anything that hasn't changed since then is left out.
+// Only a hash of each group of fields is kept here, not the fields themselves.
+
+typedef struct {
+	uint8_t version;
+	uint16_t seq; // 0 = server doesn't have anything from us, send everything
+	uint16_t seqReserved; // Numbers up to here might have been used already, carry on from here after a reboot
+	uint32_t hash[DELTA_COUNT];
+} snapshot_t;
+
+static snapshot_t snapshot;
+static uint16_t seqNext;
+static uint8_t seqLeft; // Numbers left before another block needs reserving
+
+void delta_init()
+{
+	if(!settings_readFile(DELTA_FILE, &snapshot, sizeof(snapshot)) || snapshot.version != DELTA_VERSION)
+	{
+		memset(&snapshot, 0, sizeof(snapshot));
+		snapshot.version = DELTA_VERSION;
+	}
+	seqNext = snapshot.seqReserved;
+	seqLeft = 0;
+	DBG_MAIL("Snapshot: %u (next %u)", snapshot.seq, seqNext);
+}
+
+void delta_begin(delta_t* delta)
+{
+	// A new number for each report (retries included), they only need to be unique among the ones the server is holding on to
+	// Numbers are reserved in blocks so the flash is only written once every few reports (or once per boot)
+	if(seqLeft == 0)
+	{
+		seqLeft = DELTA_SEQ_BLOCK;
+		snapshot.seqReserved = seqNext + DELTA_SEQ_BLOCK + 1; // +1 in case it wraps past 0
+		settings_writeFile(DELTA_FILE, &snapshot, sizeof(snapshot));
+	}
+	seqLeft--;
+
+	seqNext++;
+	if(seqNext == 0)
+		seqNext = 1;
+	delta->base = snapshot.seq;
+	delta->seq = seqNext;
+	memset(delta->hash, 0, sizeof(delta->hash)); // Groups that don't get checked weren't sent, so they'll be sent next time
+}
+
+uint32_t delta_hash(uint32_t hash, const void* data, uint32_t len)
+{
+	// FNV-1a
+	const uint8_t* d = data;
+	for(uint32_t i=0;i<len;i++)
+	{
+		hash ^= d[i];
+		hash *= 16777619UL;
+	}
+	return hash;
+}
+
+uint8_t delta_changed(delta_t* delta, uint8_t group, uint32_t hash)
+{
+	delta->hash[group] = hash;
+#if DELTA_REPORTS
+	return (delta->base == 0 || snapshot.hash[group] != hash);
+#else
+	return 1;
+#endif
+}
+
+void delta_acked(delta_t* delta)
+{
+	// Another report might have been acknowledged while this one was in flight, don't go backwards
+	if(snapshot.seq != 0 && (int16_t)(delta->seq - snapshot.seq) <= 0)
+		return;
+
+	// Nothing new, keep using the old snapshot instead of wearing out the flash (tracking mode reports every minute or so)
+	if(snapshot.seq != 0 && memcmp(snapshot.hash, delta->hash, sizeof(snapshot.hash)) == 0)
+		return;
+
+	snapshot.seq = delta->seq;
+	memcpy(snapshot.hash, delta->hash, sizeof(snapshot.hash));
+	settings_writeFile(DELTA_FILE, &snapshot, sizeof(snapshot));
+}
+
+void delta_resync()
+{
+	// Server doesn't have the snapshot we're sending deltas against
+	// File is kept for seqReserved
+	DBG_MAIL("Resync");
+	snapshot.seq = 0;
+	settings_writeFile(DELTA_FILE, &snapshot, sizeof(snapshot));
+}
@@ -0,0 +1,96 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#include "common.h"
+
+// SDK events arrive in the main task, but all of the job state belongs to the mailbox task.
+// This hands them over without locks, only the main task pushes and only the mailbox task pops.
+
+typedef struct {
+	API_Event_t* event;
+	millis_t time;
+} item_t;
+
+static item_t items[EVTQUEUE_SIZE];
+static volatile uint32_t head; // Written by the producer only
+static volatile uint32_t tail; // Written by the consumer only
+static uint32_t latency[EVTQUEUE_BUCKETS];
+static uint32_t dropCount;
+
+// NMEA comes in every second while the GPS is on and the next lot replaces it anyway
+static bool lossy(API_Event_t* event)
+{
+	return (event->id == API_EVENT_ID_GPS_UART_RECEIVED);
+}
+
+// Returns false if the event was dropped and wasn't taken, the caller still owns it
+// wake is set if the queue was empty, so the consumer needs waking up
+bool evtqueue_push(API_Event_t* event, bool* wake)
+{
+	uint32_t h = head;
+	*wake = (h == tail);
+
+	if(lossy(event))
+	{
+		// Mailbox task is busy (probably building the HTTP request), keep the last few slots for events that matter
+		if(h - tail >= EVTQUEUE_SIZE - EVTQUEUE_RESERVED)
+		{
+			dropCount++;
+			return false;
+		}
+	}
+	else
+	{
+		// Socket, SMS, network etc events can't be lost, something would be left waiting for them
+		// Hold up the main task until the mailbox task has made some room, it's already been woken up
+		while(h - tail >= EVTQUEUE_SIZE)
+			OS_Sleep(1);
+	}
+
+	items[h & (EVTQUEUE_SIZE - 1)].event = event;
+	items[h & (EVTQUEUE_SIZE - 1)].time = millis();
+	__sync_synchronize(); // Item must be visible before the new head
+	head = h + 1;
+
+	return true;
+}
+
+API_Event_t* evtqueue_pop()
+{
+	uint32_t t = tail;
+	if(t == head)
+		return NULL;
+	__sync_synchronize(); // Don't read the item before seeing the head
+
+	item_t* item = &items[t & (EVTQUEUE_SIZE - 1)];
+	API_Event_t* event = item->event;
+
+	millis_t diff = millis() - item->time;
+	uint8_t bucket = 0;
+	while(diff && bucket < EVTQUEUE_BUCKETS - 1)
+	{
+		diff >>= 1;
+		bucket++;
+	}
+	latency[bucket]++;
+
+	__sync_synchronize(); // Finished with the slot before giving it back
+	tail = t + 1;
+
+	return event;
+}
+
+uint32_t evtqueue_latency(uint8_t bucket)
+{
+	return latency[bucket];
+}
+
+uint32_t evtqueue_dropped()
+{
+	return dropCount;
+}
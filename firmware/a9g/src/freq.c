@@ -0,0 +1,84 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#include "common.h"
+
+static uint8_t busy; // Bit mask of FREQ_PHASE_*
+static millis_t phaseStart[FREQ_PHASE_COUNT];
+static millis_t phaseTime[FREQ_PHASE_COUNT];
+static millis_t levelStart;
+static millis_t highTime;
+static millis_t lowTime;
+
+static void setLevel(uint8_t high)
+{
+	millis_t now = millis();
+	if(high)
+		lowTime += now - levelStart;
+	else
+		highTime += now - levelStart;
+	levelStart = now;
+
+#if FREQ_GOVERNOR
+	// NOTE: In sleep mode the first few bytes on UART1 might get lost while waking up, the MCU repeats its status frame until it gets an ack so that's ok
+	PM_SetSysMinFreq(high ? FREQ_HIGH : FREQ_LOW);
+	PM_SleepMode(!high);
+#endif
+}
+
+void freq_init()
+{
+	// Stay fast until the mailbox task has started
+	levelStart = millis();
+#if !FREQ_GOVERNOR
+	PM_SetSysMinFreq(FREQ_HIGH);
+#endif
+	freq_begin(FREQ_PHASE_BOOT);
+}
+
+void freq_begin(uint8_t phase)
+{
+	uint8_t mask = (1<<phase);
+	if(busy & mask)
+		return;
+
+	phaseStart[phase] = millis();
+	if(!busy)
+		setLevel(1);
+	busy |= mask;
+}
+
+void freq_end(uint8_t phase)
+{
+	uint8_t mask = (1<<phase);
+	if(!(busy & mask))
+		return;
+
+	phaseTime[phase] += millis() - phaseStart[phase];
+	busy &= ~mask;
+	if(!busy)
+		setLevel(0);
+}
+
+millis_t freq_phaseTime(uint8_t phase)
+{
+	millis_t time = phaseTime[phase];
+	if(busy & (1<<phase))
+		time += millis() - phaseStart[phase];
+	return time;
+}
+
+millis_t freq_highTime()
+{
+	return highTime + (busy ? millis() - levelStart : 0);
+}
+
+millis_t freq_lowTime()
+{
+	return lowTime + (!busy ? millis() - levelStart : 0);
+}
@@ -39,6 +39,7 @@ static void onNetworkStatusChange(Network_Status_t status)
 			break;
 		case NETWORK_STATUS_ATTACHED:
 			DBG_GPRS("CB Attached");
+			mail_sendEvent(MAILBOX_EVENT_GPRS_ATTACHED, 0, 0, NULL, NULL);
 			break;
 		case NETWORK_STATUS_DEACTIVED:
 			DBG_GPRS("CB Deactivated");
@@ -154,6 +155,18 @@ void gprs_disconnect()
 		processConnection();
 }
 
+uint8_t gprs_isAttached()
+{
+	uint8_t attachStatus = 0;
+	return (Network_GetAttachStatus(&attachStatus) && attachStatus);
+}
+
+uint8_t gprs_isActive()
+{
+	uint8_t activeStatus = 0;
+	return (!bugLockout && Network_GetActiveStatus(&activeStatus) && activeStatus);
+}
+
 void gprs_event(API_Event_t* pEvent)
 {
 	switch(pEvent->id)
@@ -161,6 +174,7 @@ void gprs_event(API_Event_t* pEvent)
 		case API_EVENT_ID_NETWORK_ATTACHED:
 			DBG_GPRS("network attach success");
 			processConnection();
+			mail_sendEvent(MAILBOX_EVENT_GPRS_ATTACHED, 0, 0, NULL, NULL);
 			break;
 		case API_EVENT_ID_NETWORK_ATTACH_FAILED:
 			DBG_GPRS("network attach fail");
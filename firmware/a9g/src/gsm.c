@@ -9,15 +9,69 @@
 #include "common.h"
 
 static uint8_t status; // Used to figure out if we auto-reconnected to GSM network after signal loss
+static uint8_t registering;
+static uint8_t usedSavedPlmn;
+static millis_t registerStart;
+static millis_t registerTime;
+
+static void registerBegin(void)
+{
+	static const uint8_t noPlmn[6] = {0,0,0,0,0,0};
+
+	registering = 1;
+	registerStart = millis();
+	usedSavedPlmn = (memcmp(settings.plmn, noPlmn, sizeof(noPlmn)) != 0);
+
+	// Go straight for the network we used last time instead of doing a full search, MANUAL_AUTO falls back to automatic if it's not there
+	if(usedSavedPlmn)
+	{
+		DBG_GSM("Register %u%u%u%u%u%u", settings.plmn[0], settings.plmn[1], settings.plmn[2], settings.plmn[3], settings.plmn[4], settings.plmn[5]);
+		Network_Register(settings.plmn, NETWORK_REGISTER_MODE_MANUAL_AUTO);
+	}
+	else
+		Network_Register((uint8_t*)noPlmn, NETWORK_REGISTER_MODE_MANUAL);
+}
+
+static void registered(void)
+{
+	if(registering)
+	{
+		registering = 0;
+		registerTime = millis() - registerStart;
+		DBG_GSM("Registered in %ums", registerTime);
+	}
+
+	uint8_t plmn[6];
+	Network_Register_Mode_t mode;
+	if(Network_GetCurrentOperator(plmn, &mode) && memcmp(plmn, settings.plmn, sizeof(plmn)) != 0)
+	{
+		memcpy(settings.plmn, plmn, sizeof(plmn));
+		settings_save();
+	}
+}
 
 void gsm_init()
 {
-	Network_DeRegister();
+	// We only get turned on when there's something to do, so start registering right away instead of deregistering and doing it later
+	registerBegin();
 }
 
 void gsm_connect()
 {
-	Network_Register((uint8_t[]){0,0,0,0,0,0}, NETWORK_REGISTER_MODE_MANUAL);
+	if(status) // Already registered while we were doing other stuff
+		mail_sendEvent(MAILBOX_EVENT_GSM_CONNECTED, 1, 0, NULL, NULL);
+	else if(!registering)
+		registerBegin();
+}
+
+millis_t gsm_registerTime()
+{
+	return registerTime;
+}
+
+uint8_t gsm_usedSavedPlmn()
+{
+	return usedSavedPlmn;
 }
 
 void gsm_disconnect()
@@ -32,6 +86,7 @@ void gsm_event(API_Event_t* pEvent)
         case API_EVENT_ID_NETWORK_REGISTERED_HOME:
 			{
 				DBG_GSM("Network register success (home)");
+				registered();
 				led_rate(LED_NETWORK, LED_RATE_NETWORK_GSM);
 				mail_sendEvent(MAILBOX_EVENT_GSM_CONNECTED, (status == 0), 0, NULL, NULL);
 				status = 1;
@@ -70,6 +125,7 @@ void gsm_event(API_Event_t* pEvent)
 			break;
         case API_EVENT_ID_NETWORK_REGISTERED_ROAMING:
 			DBG_GSM("Network register success (roaming)");
+			registered();
 			led_rate(LED_NETWORK, LED_RATE_NETWORK_GSM);
 			mail_sendEvent(MAILBOX_EVENT_GSM_CONNECTED, (status == 0), 0, NULL, NULL);
 			status = 1;
@@ -93,6 +149,7 @@ void gsm_event(API_Event_t* pEvent)
 			DBG_GSM("Network deregistered");
 			led_rate(LED_NETWORK, LED_RATE_NETWORK_OFF);
 			status = 0;
+			registering = 0;
 			mail_sendEvent(MAILBOX_EVENT_GSM_DISCONNECTED, 0, 0, NULL, NULL);
 			break;
 		case API_EVENT_ID_SIGNAL_QUALITY:
@@ -10,25 +10,32 @@
 
 #define USERAGENT	"Mozilla/5.0 (compatible; Mail Notifier " FW_VERSION ")"
 
+#define RESP_STATUS		0
+#define RESP_HEADERS	1
+#define RESP_BODY		2
+
+// id is passed back in param1 of the events so the right HTTP instance picks them up
+
 static void callback_dns(DNS_Status_t status, void* param)
 {
+	uint8_t id = (uint32_t)param;
 	if(status == DNS_STATUS_OK)
-		mail_sendEvent(MAILBOX_EVT_HTTP_BEGIN, 0, 0, NULL, NULL);
+		mail_sendEvent(MAILBOX_EVT_HTTP_BEGIN, id, 0, NULL, NULL);
 	else
-		mail_sendEvent(MAILBOX_EVT_HTTP_DNSFAIL, 0, 0, NULL, NULL);
+		mail_sendEvent(MAILBOX_EVT_HTTP_DNSFAIL, id, 0, NULL, NULL);
 }
 
-void http_begin()
+void http_begin(uint8_t id)
 {
-	mail_sendEvent(MAILBOX_EVT_HTTP_BEGIN, 0, 0, NULL, NULL);
+	mail_sendEvent(MAILBOX_EVT_HTTP_BEGIN, id, 0, NULL, NULL);
 }
 
-int http_host(char* server, uint32_t port)
+int http_host(uint8_t id, char* server, uint32_t port)
 {
 	uint8_t ip[16];
 	memset(ip, 0, sizeof(ip));
 
-	DNS_Status_t status = DNS_GetHostByNameEX(server, ip, callback_dns, NULL); // TODO should probably pass the server name in param 4?
+	DNS_Status_t status = DNS_GetHostByNameEX(server, ip, callback_dns, (void*)(uint32_t)id);
 	if(status == DNS_STATUS_OK)
 	{
 		DBG_HTTP("Get IP success: %s -> %s", server, ip);
@@ -87,3 +94,58 @@ bool http_close(int fd)
 	bool res = Socket_TcpipClose(fd);
 	return res;
 }
+
+void http_responseBegin(http_resp_t* resp)
+{
+	resp->state = RESP_STATUS;
+	resp->spaces = 0;
+	resp->lineLen = 0;
+	resp->status = 0;
+	resp->verdict = HTTP_VERDICT_PENDING;
+	cmd_begin(&resp->cmd);
+}
+
+uint8_t http_responseFeed(http_resp_t* resp, const char* data, uint32_t len)
+{
+	// Response arrives in chunks of any size, this keeps track of where it's up to so it can be fed as it comes in
+	for(uint32_t i=0;i<len && resp->verdict == HTTP_VERDICT_PENDING;i++)
+	{
+		char c = data[i];
+
+		if(resp->state == RESP_STATUS) // HTTP/1.0 200 OK
+		{
+			if(c == ' ')
+				resp->spaces++;
+			else if(resp->spaces == 1 && c >= '0' && c <= '9' && resp->status < 1000)
+				resp->status = (resp->status * 10) + (c - '0');
+			else if(c == '\n')
+			{
+				DBG_HTTP("Status %u", resp->status);
+				if(resp->status < 200 || resp->status > 299)
+					resp->verdict = HTTP_VERDICT_FAIL;
+				resp->state = RESP_HEADERS;
+				resp->lineLen = 0;
+			}
+		}
+		else if(resp->state == RESP_HEADERS) // Not interested in any of them, just look for the blank line
+		{
+			if(c == '\n')
+			{
+				if(resp->lineLen == 0)
+					resp->state = RESP_BODY;
+				resp->lineLen = 0;
+			}
+			else if(c != '\r')
+				resp->lineLen = 1;
+		}
+		else
+		{
+			cmd_feed(&resp->cmd, data + i, len - i);
+			if(cmd_done(&resp->cmd))
+				resp->verdict = cmd_resultOk(&resp->cmd) ? HTTP_VERDICT_OK : HTTP_VERDICT_FAIL;
+			break;
+		}
+	}
+
+	return resp->verdict;
+}
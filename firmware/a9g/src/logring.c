@@ -0,0 +1,236 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#include "common.h"
+#include <stdarg.h>
+
+#if LOG_RING
+
+#define ARGS_MAX	4
+#define STR_MAXLEN	15
+
+typedef struct {
+	millis_t time;
+	const char* fmt;
+	uint32_t args[ARGS_MAX]; // Anything past this is printed as 0
+	char str[STR_MAXLEN + 1]; // Copy of the first %s argument, the original might not be around by the time it's formatted
+} record_t;
+
+static record_t ring[LOG_RING_SIZE];
+static uint16_t head; // Next record to write
+static uint16_t count;
+static uint32_t dropped;
+
+// Skips over flags, width, precision and length, returns pointer to the conversion character
+static const char* convSpec(const char* p)
+{
+	while(*p && strchr("-+ #0123456789.lh", *p) != NULL)
+		p++;
+	return p;
+}
+
+void logring_init()
+{
+	head = 0;
+	count = 0;
+	dropped = 0;
+}
+
+void logring_record(const char* fmt, ...)
+{
+	// Built on the stack first, only the copy into the ring needs to be in the critical section
+	record_t rec;
+	record_t* r = &rec;
+	r->time = millis();
+	r->fmt = fmt;
+	r->str[0] = '\0';
+
+	// Only need to know the argument types here, no formatting
+	va_list ap;
+	va_start(ap, fmt);
+	uint8_t argc = 0;
+	uint8_t haveStr = 0;
+	for(const char* p = fmt; *p; p++)
+	{
+		if(*p != '%')
+			continue;
+		p++;
+		if(*p == '%')
+			continue;
+		p = convSpec(p);
+		if(!*p)
+			break;
+
+		uint32_t value = 0;
+		switch(*p)
+		{
+			case 'f':
+			{
+				float f = va_arg(ap, double);
+				memcpy(&value, &f, sizeof(value));
+			}
+				break;
+			case 's':
+			{
+				const char* s = va_arg(ap, const char*);
+				if(!haveStr)
+				{
+					strncpy(r->str, (s != NULL) ? s : "(null)", STR_MAXLEN);
+					r->str[STR_MAXLEN] = '\0';
+					haveStr = 1;
+				}
+			}
+				break;
+			case 'p':
+				value = (uint32_t)va_arg(ap, void*);
+				break;
+			default: // d, u, x, c
+				value = va_arg(ap, uint32_t);
+				break;
+		}
+
+		if(*p != 's' && argc < ARGS_MAX) // Strings go in r->str
+			r->args[argc++] = value;
+	}
+	va_end(ap);
+
+	// Messages come from more than one task, a slot mustn't be visible to drain until it's filled
+	uint32_t cs = OS_EnterCriticalSection();
+	ring[head] = rec;
+	head = (head + 1) % LOG_RING_SIZE;
+	if(count < LOG_RING_SIZE)
+		count++;
+	else
+		dropped++;
+	OS_ExitCriticalSection(cs);
+}
+
+static uint32_t format(const record_t* r, char* buff, uint32_t len)
+{
+	uint32_t idx = snprintf(buff, len, ":(%u)", r->time);
+	uint8_t argc = 0;
+	uint8_t usedStr = 0;
+	const char* p = r->fmt;
+
+	while(*p && idx < len - 1)
+	{
+		if(*p != '%')
+		{
+			buff[idx++] = *p++;
+			continue;
+		}
+
+		// Format each conversion on its own with the original spec
+		const char* start = p++;
+		if(*p == '%')
+		{
+			buff[idx++] = '%';
+			p++;
+			continue;
+		}
+		p = convSpec(p);
+		if(!*p)
+			break;
+
+		char spec[12];
+		uint32_t specLen = p - start + 1;
+		if(specLen >= sizeof(spec))
+			specLen = sizeof(spec) - 1;
+		memcpy(spec, start, specLen);
+		spec[specLen] = '\0';
+
+		uint32_t value = 0;
+		if(*p != 's')
+		{
+			if(argc < ARGS_MAX)
+				value = r->args[argc];
+			argc++;
+		}
+
+		int res;
+		if(*p == 'f')
+		{
+			float f;
+			memcpy(&f, &value, sizeof(f));
+			res = snprintf(buff + idx, len - idx, spec, f);
+		}
+		else if(*p == 's')
+		{
+			res = snprintf(buff + idx, len - idx, spec, usedStr ? "?" : r->str);
+			usedStr = 1;
+		}
+		else
+			res = snprintf(buff + idx, len - idx, spec, value);
+
+		if(res > 0)
+			idx += res;
+		if(idx > len - 1)
+			idx = len - 1;
+		p++;
+	}
+
+	buff[idx] = '\0';
+	return idx;
+}
+
+void logring_drain()
+{
+	char buff[160];
+
+	if(dropped)
+		Trace(1, "LOG: %u dropped", dropped);
+
+	while(count)
+	{
+		uint32_t cs = OS_EnterCriticalSection();
+		record_t r = ring[(head + LOG_RING_SIZE - count) % LOG_RING_SIZE];
+		count--;
+		OS_ExitCriticalSection(cs);
+
+		format(&r, buff, sizeof(buff));
+		Trace(1, "%s", buff);
+	}
+	dropped = 0;
+}
+
+uint8_t logring_get(uint16_t age, char* buff, uint32_t len)
+{
+	// age 0 = newest
+	uint32_t cs = OS_EnterCriticalSection();
+	if(age >= count)
+	{
+		OS_ExitCriticalSection(cs);
+		return 0;
+	}
+	record_t r = ring[(head + LOG_RING_SIZE - 1 - age) % LOG_RING_SIZE];
+	OS_ExitCriticalSection(cs);
+
+	format(&r, buff, len);
+	return 1;
+}
+
+#else
+
+void logring_init()
+{
+}
+
+void logring_record(const char* fmt, ...)
+{
+}
+
+void logring_drain()
+{
+}
+
+uint8_t logring_get(uint16_t age, char* buff, uint32_t len)
+{
+	return 0;
+}
+
+#endif
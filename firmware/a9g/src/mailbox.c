@@ -17,6 +17,15 @@
 #define SMSBAL_NONE	0
 #define SMSBAL_SUCCESS	1
 #define SMSBAL_FAIL	2
+#define SMSBAL_PENDING	3 // Still waiting for the reply when the report was sent
+#define SMSBAL_LATE	4 // Reply arrived after the report last time
+
+#define BALANCE_FILE	"/balance.dat"
+
+// Which job's SMS is waiting for API_EVENT_ID_SMS_SENT/ERROR, only one is sent at a time since the events don't say which send they're for
+#define SMSSEND_NONE		0
+#define SMSSEND_BALANCE		1
+#define SMSSEND_FALLBACK	2
 
 #define PWROFF_UNKNOWN	0
 #define PWROFF_FAILURE	1
@@ -26,13 +35,17 @@ typedef struct {
 	uint16_t success;
 	uint16_t failure;
 	uint16_t timeout;
+	uint16_t stuckPolls;
+	uint32_t uptime; // MCU uptime (seconds)
 } counts_t;
 
 typedef struct {
 	uint8_t newmail;
+	uint8_t mailcount;
 	uint8_t endcharging;
 	uint8_t trackMode;
 	uint8_t switchstuck;
+	uint8_t heartbeat;
 } reasons_t;
 
 typedef struct {
@@ -55,6 +68,7 @@ struct job_t {
 	onProcess_t onProcess;
 	onComplete_t onComplete;
 	void* onCompleteParam;
+	void* ctx; // Per-instance state for jobs that can have more than one instance
 	// onFailure?
 	// onSuccess?
 	// onComplete?
@@ -66,6 +80,7 @@ static uint8_t job_process_environmentData(job_t* job, uint8_t action, void* dat
 static uint8_t job_process_requestInfo(job_t* job, uint8_t action, void* data);
 static uint8_t job_process_gsmConnect(job_t* job, uint8_t action, void* data);
 static uint8_t job_process_smsBalance(job_t* job, uint8_t action, void* data);
+static uint8_t job_process_smsFallback(job_t* job, uint8_t action, void* data);
 static uint8_t job_process_waitAttach(job_t* job, uint8_t action, void* data);
 static uint8_t job_process_gprsConnect(job_t* job, uint8_t action, void* data);
 static uint8_t job_process_gps(job_t* job, uint8_t action, void* data);
@@ -73,6 +88,8 @@ static uint8_t job_process_http(job_t* job, uint8_t action, void* data);
 static uint8_t job_process_gprsDisconnect(job_t* job, uint8_t action, void* data);
 static uint8_t job_process_gsmDisconnect(job_t* job, uint8_t action, void* data);
 static uint8_t job_process_requestPoweroff(job_t* job, uint8_t action, void* data);
+static uint8_t job_process_linkTest(job_t* job, uint8_t action, void* data);
+static uint8_t httpStart(onComplete_t onComplete, void* onCompleteParam);
 
 static job_t job_clearSMSs = {
 	0, 0, 0,
@@ -94,7 +111,7 @@ static job_t job_environmentData = {
 
 static job_t job_requestInfo = {
 	0, 0, 0,
-	1000,
+	3000,
 	1,
 	job_process_requestInfo,
 	NULL,
@@ -128,6 +145,15 @@ static job_t job_smsBalance = {
 	NULL
 };
 
+static job_t job_smsFallback = {
+	0, 0, 0,
+	30000,
+	1,
+	job_process_smsFallback,
+	NULL,
+	NULL
+};
+
 static job_t job_gprsConnect = {
 	0, 0, 0,
 	60000,
@@ -146,14 +172,36 @@ static job_t job_gps = {
 	NULL
 };
 
-static job_t job_http = {
-	0, 0, 0,
-	30000,
-	1,
-	job_process_http,
-	NULL,
-	NULL
-};
+typedef struct {
+	uint8_t id;
+	int fd; // 0 = no socket, or it's been handed over to httpSockets[] to finish closing
+	uint8_t retryWait;
+	millis_t retryDelay;
+	millis_t sentTime;
+	uint8_t successful;
+	http_resp_t resp;
+	delta_t delta;
+	uint32_t trackId; // Newest track point in the report, 0 = none
+} httpCtx_t;
+
+// Pool of HTTP instances, each one owns a socket fd and only handles events for that fd.
+// Set up by httpInit(), use httpStart() to get one going.
+static job_t job_http[HTTP_INSTANCES];
+static httpCtx_t httpCtx[HTTP_INSTANCES];
+
+#define HTTP_CLOSE_TIMEOUT	5000 // Stop waiting for SOCKET_CLOSED after this long (ms)
+
+typedef struct {
+	int fd; // 0 = free
+	uint8_t closing;
+	millis_t closeTime;
+} httpSocket_t;
+
+// Socket of each HTTP instance, open or still closing.
+// The SDK can give a fd out again while the CLOSED event for its last use is still queued up, so socket events
+// are routed through here by httpEvent() instead of each instance comparing fds. An instance isn't started
+// again until its old socket has finished closing.
+static httpSocket_t httpSockets[HTTP_INSTANCES];
 
 static job_t job_gprsDisconnect = {
 	0, 0, 0,
@@ -182,6 +230,15 @@ static job_t job_requestPoweroff = {
 	NULL
 };
 
+static job_t job_linkTest = {
+	0, 0, 0,
+	60000,
+	0,
+	job_process_linkTest,
+	NULL,
+	NULL
+};
+
 static job_t* jobs[] = {
 	&job_clearSMSs,
 	&job_environmentData,
@@ -189,12 +246,13 @@ static job_t* jobs[] = {
 	&job_gsmConnect,
 	&job_waitAttach,
 	&job_smsBalance,
+	&job_smsFallback,
 	&job_gprsConnect,
 	&job_gps,
-	&job_http,
 	&job_gprsDisconnect,
 	&job_gsmDisconnect,
-	&job_requestPoweroff
+	&job_requestPoweroff,
+	&job_linkTest
 };
 
 extern char* fwBuild;
@@ -202,26 +260,23 @@ static HANDLE mailboxTaskHandle = NULL;
 static counts_t counts;
 static reasons_t reasons;
 static uint8_t vlmDetected;
+static uint8_t statusReady; // Got the first status frame from the MCU, waiting for the request info job to take it
+static uint8_t statusTaken;
 static smsBalance_t smsBalance;
-static int fd_http;
-static uint8_t fd_http_closing;
+static uint8_t balanceReported; // Report went out while still waiting for the balance reply
+static uint8_t balanceLate; // smsBalance was loaded from BALANCE_FILE
 static uint8_t battPercent;
 static uint16_t battVoltage;
 static uint8_t powerOffStatus;
-
-static void printStackHeap(void)
-{
-	OS_Task_Info_t info;
-	OS_GetTaskInfo(mailboxTaskHandle, &info);
-	volatile uint32_t j = 0;
-	uint32_t last_bytes = (uint32_t)&j - info.stackTop;
-	uint32_t all_bytes  = info.stackSize * 4;
-
-	OS_Heap_Status_t osHeapStatus;
-	OS_GetHeapUsageStatus(&osHeapStatus);
-
-	PRINTD("STACK: %u/%u | HEAP: %u/%u", all_bytes - last_bytes, all_bytes, osHeapStatus.usedSize, osHeapStatus.totalSize);
-}
+static millis_t smsClearTime; // How long the boot was held up by clearing SMSs
+static bool mailAgeValid;
+static millis_t mailAge; // Age of the first mail trigger when the MCU sent its status (ms)
+static millis_t mailAgeTime; // When that status came in
+static millis_t httpVerdictTime; // Request sent to response result (last one to finish)
+static millis_t shutdownTime;
+static uint8_t shutdownHeld; // Background SMS stuff still going after the report, the power off waits for it
+static uint8_t poweroffWaiting;
+static uint8_t smsSender;
 
 static void callback_smsList(SMS_Message_Info_t* messageInfo)
 {
@@ -246,7 +301,7 @@ static void callback_smsNewMessage(SMS_Encode_Type_t encodeType, uint32_t conten
 {
 	// " 2732",,"2019/08/10,20:41:52+01",129,17,0,0,"+447958879880",145,21
 	if(
-		smsBalance.state != SMSBAL_SUCCESS &&
+		smsBalance.state != SMSBAL_SUCCESS && // Could be SMSBAL_LATE, a new balance is better
 		encodeType == SMS_ENCODE_TYPE_ASCII &&
 		contentLength < sizeof(smsBalance.content) &&
 		memcmp(header, "\"" BAL_NUM_RECV "\"", 7) == 0
@@ -299,23 +354,37 @@ static void job_next(job_t* job, job_t* next, onComplete_t onComplete, void* onC
 		job_run(next, onComplete, onCompleteParam);
 }
 
+static void onBootSMSsCleared(void* param, uint8_t success)
+{
+	smsClearTime = millis() - smsClearTime;
+	job_next(NULL, &job_environmentData, NULL, NULL);
+}
+
 static uint8_t job_process_clearSMSs(job_t* job, uint8_t action, void* data)
 {
+	// Normally runs in the background after the HTTP report, only runs at boot if the SIM is nearly full
+
 	if(action == JOB_RUN || action == JOB_UPDATE)
 	{
 		if(action == JOB_RUN)
 			DBG_MAIL("JOB RUN: CLEAR SMS...");
 
-		if(sms_clearAll())
+		uint8_t done = sms_clearStep(2);
+
+		if(done)
 		{
 			DBG_MAIL("All SMSs deleted");
-			job_next(job, &job_environmentData, NULL, NULL);
+			job_next(job, NULL, NULL, NULL);
+			if(job->onComplete != NULL)
+				job->onComplete(job->onCompleteParam, 1);
 		}
 	}
 	else if(action == JOB_TIMEOUT)
 	{
+		// Carry on next time
 		DBG_MAIL("JOB TO: CLEAR SMS");
-		job_next(job, &job_environmentData, NULL, NULL);
+		if(job->onComplete != NULL)
+			job->onComplete(job->onCompleteParam, 0);
 	}
 	else if(action == JOB_EVENT)
 	{
@@ -335,12 +404,14 @@ static uint8_t job_process_environmentData(job_t* job, uint8_t action, void* dat
 	{
 		if(bme280_status() == 0)
 		{
+			bme280_data_t env;
+			uint8_t res = bme280_read(&env);
 			PRINTD(
 				"%u, Temp: %.2f, Press: %.3f, Humidity: %.3f",
-				bme280_status(),
-				(bme280_readTemperature() / 100.0),
-				((bme280_readPressure() / 256.0) / 100.0),
-				(bme280_readHumidity() / 1024.0)
+				res,
+				(env.temperature / 100.0),
+				((env.pressure / 256.0) / 100.0),
+				(env.humidity / 1024.0)
 			);
 			job_next(job, &job_requestInfo, NULL, NULL);
 		}
@@ -357,21 +428,100 @@ static uint8_t job_process_environmentData(job_t* job, uint8_t action, void* dat
 	return 0;
 }
 
+static void statusUpdate(void)
+{
+	uint8_t* buff = mailcomm_getBuff();
+	uint8_t flags = buff[MAIL_COMM_FRAME_FLAGS];
+
+	vlmDetected = (flags>>MAIL_COMM_FLAG_VLM) & 0x01;
+
+	if(!statusTaken)
+	{
+		// The MCU only sends the wake reasons in its first frame, a repeat (our ack got lost) will have them cleared so merge them in
+		counts.success =		(buff[MAIL_COMM_FRAME_SUCCESS]<<8) | buff[MAIL_COMM_FRAME_SUCCESS + 1];
+		counts.failure =		(buff[MAIL_COMM_FRAME_FAILURE]<<8) | buff[MAIL_COMM_FRAME_FAILURE + 1];
+		counts.timeout =		(buff[MAIL_COMM_FRAME_TIMEOUT]<<8) | buff[MAIL_COMM_FRAME_TIMEOUT + 1];
+		counts.stuckPolls =		(buff[MAIL_COMM_FRAME_STUCKPOLLS]<<8) | buff[MAIL_COMM_FRAME_STUCKPOLLS + 1];
+		counts.uptime =			((uint32_t)buff[MAIL_COMM_FRAME_UPTIME]<<24) | ((uint32_t)buff[MAIL_COMM_FRAME_UPTIME + 1]<<16) | (buff[MAIL_COMM_FRAME_UPTIME + 2]<<8) | buff[MAIL_COMM_FRAME_UPTIME + 3];
+		smsBalance.get |=		(flags>>MAIL_COMM_FLAG_SMSBAL) & 0x01;
+		reasons.newmail |=		(flags>>MAIL_COMM_FLAG_NEWMAIL) & 0x01;
+		if(buff[MAIL_COMM_FRAME_MAILCOUNT] > reasons.mailcount)
+			reasons.mailcount =	buff[MAIL_COMM_FRAME_MAILCOUNT];
+		reasons.endcharging |=	(flags>>MAIL_COMM_FLAG_ENDCHARGING) & 0x01;
+		reasons.trackMode =		(flags>>MAIL_COMM_FLAG_TRACKMODE) & 0x01;
+		reasons.switchstuck |=	(flags>>MAIL_COMM_FLAG_SWITCHSTUCK) & 0x01;
+		reasons.heartbeat |=	(flags>>MAIL_COMM_FLAG_HEARTBEAT) & 0x01;
+		uint16_t age =			(buff[MAIL_COMM_FRAME_MAILAGE]<<8) | buff[MAIL_COMM_FRAME_MAILAGE + 1];
+		if(age != MAIL_COMM_MAILAGE_NONE && !mailAgeValid)
+		{
+			mailAgeValid = true;
+			mailAge = ((millis_t)age * 1000) / MAIL_COMM_TICK_HZ;
+			mailAgeTime = millis();
+		}
+		statusReady = 1;
+	}
+	else if(!((flags>>MAIL_COMM_FLAG_TRACKMODE) & 0x01))
+	{
+		// Track mode has been turned off
+		reasons.trackMode = 0;
+		if(job_gps.running)
+			job_next(&job_gps, NULL, NULL, NULL);
+	}
+}
+
+static void job_requestInfo_take(job_t* job)
+{
+	DBG_MAIL("JOB EVT: REQ INFO");
+
+	statusReady = 0;
+	statusTaken = 1;
+
+	mailcomm_heartbeat(settings.heartbeat);
+
+	if(reasons.trackMode || reasons.newmail || reasons.endcharging || reasons.switchstuck || reasons.heartbeat)
+	{
+		// Server asked for a balance check last time
+		if(settings.balForce)
+		{
+			smsBalance.get = 1;
+			settings.balForce = 0;
+			settings_save();
+		}
+
+		// We'll be talking to the MCU for a while yet, speed up the link
+		mailcomm_negotiate();
+		job_next(job, &job_gsmConnect, NULL, NULL);
+	}
+	else // Nothing to do
+	{
+		powerOffStatus = PWROFF_SUCCESS;
+		job_next(job, &job_requestPoweroff, NULL, NULL);
+	}
+}
+
 static uint8_t job_process_requestInfo(job_t* job, uint8_t action, void* data)
 {
+	// The MCU pushes its status as soon as we're turned on, it has usually arrived by the time this job runs
 	if(action == JOB_RUN)
 	{
 		DBG_MAIL("JOB RUN: REQ INFO...");
-		mailcomm_request();
+		if(statusReady)
+			job_requestInfo_take(job);
 	}
 	else if(action == JOB_UPDATE)
 	{
+		// Still nothing, the push probably got garbled (bad checksum), ask for it again
+		// MCU firmware from before the frame version can't be talked to at all, its frames are ignored
+		if(job->retries == 0 && millis() - job->startTime >= 500)
+		{
+			job->retries++;
+			mailcomm_request();
+		}
 	}
 	else if(action == JOB_TIMEOUT)
 	{
 		DBG_MAIL("JOB TO: REQ INFO");
 		// Wait for MCU timeout failure...
-		// TODO go to 32k low power mode? (not for GPS mode)
 	}
 	else if(action == JOB_EVENT)
 	{
@@ -379,47 +529,8 @@ static uint8_t job_process_requestInfo(job_t* job, uint8_t action, void* data)
 		switch(event->id)
 		{
 			case MAILBOX_EVT_MAILCOMM_RESPONSE:
-			{
-				if(job->running)
-				{
-					uint8_t* buff = mailcomm_getBuff();
-					if(buff != NULL)
-					{
-						DBG_MAIL("JOB EVT: REQ INFO");
-						
-						if(reasons.trackMode) 
-						{
-							job_next(job, NULL, NULL, NULL);
-
-							vlmDetected = (buff[8]>>4) & 0x01;
-
-							// a little bit hacky
-							if(!((buff[8]>>1) & 0x01))
-								job_next(&job_gps, NULL, NULL, NULL);
-						}
-						else
-						{
-							counts.success = 		(buff[2]<<8) | buff[3];
-							counts.failure = 		(buff[4]<<8) | buff[5];
-							counts.timeout = 		(buff[6]<<8) | buff[7];
-							smsBalance.get =		(buff[8]>>5) & 0x01;
-							vlmDetected =			(buff[8]>>4) & 0x01;
-							reasons.newmail =		(buff[8]>>3) & 0x01;
-							reasons.endcharging =	(buff[8]>>2) & 0x01;
-							reasons.trackMode =		(buff[8]>>1) & 0x01;
-							reasons.switchstuck =	(buff[8]>>0) & 0x01;
-
-							if(reasons.trackMode || reasons.newmail || reasons.endcharging || reasons.switchstuck)
-								job_next(job, &job_gsmConnect, NULL, NULL);
-							else // Nothing to do
-							{
-								powerOffStatus = PWROFF_SUCCESS;
-								job_next(job, &job_requestPoweroff, NULL, NULL);
-							}
-						}
-					}
-				}
-			}
+				if(job->running && statusReady)
+					job_requestInfo_take(job);
 				break;
 			default:
 				break;
@@ -473,39 +584,53 @@ static uint8_t job_process_gsmConnect(job_t* job, uint8_t action, void* data)
 	return 0;
 }
 
+static void attached(job_t* job)
+{
+	// The balance reply can take a while, get it going in the background while GPRS connects and the report is sent
+	if(smsBalance.get)
+		job_run(&job_smsBalance, NULL, NULL);
+	job_next(job, &job_gprsConnect, NULL, NULL);
+}
+
 static uint8_t job_process_waitAttach(job_t* job, uint8_t action, void* data)
 {
 	// Waiting for the attach thing seems be make GPRS and SMS stuff a bit more reliable
+	// gprs.c sends MAILBOX_EVENT_GPRS_ATTACHED, might have already attached while registering though
 
 	if(action == JOB_RUN)
 	{
 		DBG_MAIL("JOB RUN: ATTACH WAIT...");
+		if(gprs_isAttached())
+		{
+			DBG_MAIL("JOB RUN: ALREADY ATTACHED");
+			attached(job);
+		}
 	}
 	else if(action == JOB_UPDATE)
 	{
-		uint8_t attachStatus;
-		bool attachRet = Network_GetAttachStatus(&attachStatus);
-		if(attachRet && attachStatus)
-		{
-			DBG_MAIL("JOB UPT: ATTACHED!");
-			if(smsBalance.get)
-				job_next(job, &job_smsBalance, NULL, NULL);
-			else
-				job_next(job, &job_gprsConnect, NULL, NULL);
-		}
 	}
 	else if(action == JOB_TIMEOUT)
 	{
 		DBG_MAIL("JOB TO: ATTACH");
 	
 		// Carry on anyway and hope for the best...
-		if(smsBalance.get)
-			job_next(job, &job_smsBalance, NULL, NULL);
-		else
-			job_next(job, &job_gprsConnect, NULL, NULL);
+		attached(job);
 	}
 	else if(action == JOB_EVENT)
 	{
+		API_Event_t* event = (API_Event_t*)data;
+		switch(event->id)
+		{
+			case MAILBOX_EVENT_GPRS_ATTACHED:
+				if(job->running)
+				{
+					DBG_MAIL("JOB EVT: ATTACHED!");
+					attached(job);
+				}
+				break;
+			default:
+				break;
+		}
 	}
 	
 	return 0;
@@ -516,16 +641,24 @@ static uint8_t job_process_smsBalance(job_t* job, uint8_t action, void* data)
 	if(action == JOB_RUN)
 	{
 		DBG_MAIL("JOB RUN: GET BAL...");
-		sms_send(BAL_NUM_SEND, BAL_MSG);
+		smsBalance.state = SMSBAL_PENDING;
+		if(smsSender == SMSSEND_NONE && sms_send(BAL_NUM_SEND, BAL_MSG))
+			smsSender = SMSSEND_BALANCE;
+		else
+		{
+			smsBalance.state = SMSBAL_FAIL;
+			job_next(job, NULL, NULL, NULL);
+		}
 	}
 	else if(action == JOB_UPDATE)
 	{
 	}
 	else if(action == JOB_TIMEOUT)
 	{
+		// Reply might still turn up later, callback_smsNewMessage() will still take it
 		DBG_MAIL("JOB TO: GET BAL");
-		smsBalance.state = SMSBAL_FAIL;
-		job_next(job, &job_gprsConnect, NULL, NULL);
+		if(smsBalance.state == SMSBAL_PENDING && !balanceReported)
+			smsBalance.state = SMSBAL_FAIL;
 	}
 	else if(action == JOB_EVENT)
 	{
@@ -533,14 +666,158 @@ static uint8_t job_process_smsBalance(job_t* job, uint8_t action, void* data)
 
 		switch(event->id)
 		{
+			case API_EVENT_ID_SMS_SENT:
+				if(smsSender == SMSSEND_BALANCE)
+					smsSender = SMSSEND_NONE;
+				break;
+			case API_EVENT_ID_SMS_ERROR:
+				if(smsSender == SMSSEND_BALANCE)
+				{
+					smsSender = SMSSEND_NONE;
+					if(job->running)
+					{
+						DBG_MAIL("JOB EVT: BAL SEND FAIL");
+						if(!balanceReported)
+							smsBalance.state = SMSBAL_FAIL;
+						job_next(job, NULL, NULL, NULL);
+					}
+				}
+				break;
 			case MAILBOX_EVT_GOTBAL:
 				if(job->running)
 				{
 					DBG_MAIL("JOB EVT: GOT BAL");
-					job_next(job, &job_gprsConnect, NULL, NULL);
+					job_next(job, NULL, NULL, NULL);
 				}
 				else
-					DBG_MAIL("JOB EVT: GOT UNEXPECTED BAL");
+					DBG_MAIL("JOB EVT: GOT LATE BAL");
+
+				// Missed the report, keep it for next time
+				if(balanceReported)
+				{
+					balanceReported = 0;
+					settings_writeFile(BALANCE_FILE, &smsBalance, sizeof(smsBalance));
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	
+	return 0;
+}
+
+static uint8_t smsFallbackWanted(void)
+{
+#if SMS_FALLBACK
+	// Tracking mode needs GPRS, only worth it for one-off notifications
+	return (!reasons.trackMode && (reasons.newmail || reasons.endcharging || reasons.switchstuck || reasons.heartbeat));
+#else
+	return 0;
+#endif
+}
+
+static void gprsFailed(job_t* job)
+{
+	// GSM is still registered so SMS should work, much better than rebooting and trying everything again
+	if(smsFallbackWanted())
+		job_next(job, &job_smsFallback, NULL, NULL);
+	else
+	{
+		powerOffStatus = PWROFF_FAILURE;
+		job_next(job, &job_gsmDisconnect, NULL, NULL);
+	}
+}
+
+static void smsFallbackSend(job_t* job)
+{
+	Network_Signal_Quality_t gsmSignal;
+	Network_GetSignalQuality(&gsmSignal);
+
+	// Parsed by smsgateway.php, keep it short and under 160 characters
+	char msg[96];
+	snprintf(
+		msg,
+		sizeof(msg),
+		"MN1 nm=%u mc=%u ec=%u ss=%u hb=%u bv=%u bp=%u vl=%u cs=%u cf=%u ct=%u sg=%u",
+		reasons.newmail,
+		reasons.mailcount,
+		reasons.endcharging,
+		reasons.switchstuck,
+		reasons.heartbeat,
+		battVoltage,
+		battPercent,
+		vlmDetected,
+		counts.success,
+		counts.failure,
+		counts.timeout,
+		gsmSignal.signalLevel
+		);
+
+	if(sms_send(SMS_FALLBACK_NUM, msg))
+		smsSender = SMSSEND_FALLBACK;
+	else
+	{
+		powerOffStatus = PWROFF_FAILURE;
+		job_next(job, &job_gsmDisconnect, NULL, NULL);
+	}
+}
+
+static uint8_t job_process_smsFallback(job_t* job, uint8_t action, void* data)
+{
+	static uint8_t waiting;
+
+	if(action == JOB_RUN)
+	{
+		DBG_MAIL("JOB RUN: SMS FALLBACK...");
+
+		// Balance request was sent at the same time as GPRS started connecting, wait for it to go (or fail) first
+		waiting = (smsSender != SMSSEND_NONE);
+		if(waiting)
+			DBG_MAIL("SMS FALLBACK waiting for BAL send");
+		else
+			smsFallbackSend(job);
+	}
+	else if(action == JOB_UPDATE)
+	{
+		if(waiting && smsSender == SMSSEND_NONE)
+		{
+			waiting = 0;
+			smsFallbackSend(job);
+		}
+	}
+	else if(action == JOB_TIMEOUT)
+	{
+		DBG_MAIL("JOB TO: SMS FALLBACK");
+		powerOffStatus = PWROFF_FAILURE;
+		job_next(job, &job_gsmDisconnect, NULL, NULL);
+	}
+	else if(action == JOB_EVENT)
+	{
+		API_Event_t* event = (API_Event_t*)data;
+		switch(event->id)
+		{
+			case API_EVENT_ID_SMS_SENT:
+				if(smsSender != SMSSEND_FALLBACK)
+					break;
+				smsSender = SMSSEND_NONE;
+				if(job->running)
+				{
+					DBG_MAIL("JOB EVT: SMS FALLBACK SENT");
+					powerOffStatus = PWROFF_SUCCESS;
+					job_next(job, &job_gsmDisconnect, NULL, NULL);
+				}
+				break;
+			case API_EVENT_ID_SMS_ERROR:
+				if(smsSender != SMSSEND_FALLBACK)
+					break;
+				smsSender = SMSSEND_NONE;
+				if(job->running)
+				{
+					DBG_MAIL("JOB EVT: SMS FALLBACK FAIL");
+					powerOffStatus = PWROFF_FAILURE;
+					job_next(job, &job_gsmDisconnect, NULL, NULL);
+				}
 				break;
 			default:
 				break;
@@ -550,13 +827,54 @@ static uint8_t job_process_smsBalance(job_t* job, uint8_t action, void* data)
 	return 0;
 }
 
+static void requestPoweroff(void)
+{
+	// With FAST_SHUTDOWN the MCU has already counted the result and this just cuts power early
+	if(shutdownTime)
+		DBG_MAIL("Disconnect took %ums", millis() - shutdownTime);
+	logring_drain();
+	mailcomm_poweroff(powerOffStatus);
+}
+
+static void shutdownCheck(void)
+{
+	// Clearing the SIM (5 second timeout) and waiting for the balance reply (20 seconds from when it was sent) carry on after the report,
+	// the MCU would cut them off if it was told to start its grace period or power off
+	if(!shutdownHeld || job_clearSMSs.running || job_smsBalance.running)
+		return;
+	shutdownHeld = 0;
+
+#if FAST_SHUTDOWN
+	// Nothing else to wait for, the MCU gives us a few seconds to disconnect from the network (and get the FIN out) before it cuts power
+	mailcomm_poweroff(powerOffStatus | MAIL_COMM_POWEROFF_GRACE);
+#endif
+
+	// Already disconnected
+	if(poweroffWaiting)
+	{
+		poweroffWaiting = 0;
+		requestPoweroff();
+	}
+}
+
 static void onSingleRequestComplete(void* param, uint8_t success)
 {
 	// TODO we should wait a few seconds before disconnecting from GPRS so that the FIN,ACK packet from http_close() can reach the server, and maybe
 	// receive the ACK response, otherwise the server connection will be stuck in CLOSE_WAIT (or maybe FIN_WAIT2) state for a while.
 
 	powerOffStatus = success ? PWROFF_SUCCESS : PWROFF_FAILURE;
+	shutdownTime = millis();
+
+	// Critical stuff is done, now there's time to format the debug messages
+	logring_drain();
+
 	job_next(NULL, &job_gprsDisconnect, NULL, NULL);
+
+	// Tidy up the SIM while disconnecting
+	// The MCU's grace period (FAST_SHUTDOWN) and the final power off are held back until this and any balance reply are done, see shutdownCheck()
+	job_run(&job_clearSMSs, NULL, NULL);
+	shutdownHeld = 1;
+	shutdownCheck();
 }
 
 static uint8_t job_process_gprsConnect(job_t* job, uint8_t action, void* data)
@@ -564,7 +882,20 @@ static uint8_t job_process_gprsConnect(job_t* job, uint8_t action, void* data)
 	if(action == JOB_RUN)
 	{
 		DBG_MAIL("JOB RUN: GPRS CONNECT...");
-		gprs_connect();
+
+		// GPRS is unlikely to work with a really weak signal, go straight to SMS
+		Network_Signal_Quality_t gsmSignal;
+		if(
+			smsFallbackWanted() &&
+			Network_GetSignalQuality(&gsmSignal) &&
+			gsmSignal.signalLevel < SMS_FALLBACK_MINSIGNAL
+		)
+		{
+			DBG_MAIL("Weak signal %d", gsmSignal.signalLevel);
+			gprsFailed(job);
+		}
+		else
+			gprs_connect();
 	}
 	else if(action == JOB_UPDATE)
 	{
@@ -579,8 +910,7 @@ static uint8_t job_process_gprsConnect(job_t* job, uint8_t action, void* data)
 		//DBG_MAIL("Rebooting...");
 		//PM_Restart();
 
-		powerOffStatus = PWROFF_FAILURE;
-		job_next(job, &job_gsmDisconnect, NULL, NULL);
+		gprsFailed(job);
 	}
 	else if(action == JOB_EVENT)
 	{
@@ -600,8 +930,11 @@ static uint8_t job_process_gprsConnect(job_t* job, uint8_t action, void* data)
 
 					if(reasons.trackMode)
 						job_next(job, &job_gps, NULL, NULL);
-					else if(reasons.newmail || reasons.endcharging || reasons.switchstuck)
-						job_next(job, &job_http, onSingleRequestComplete, NULL);
+					else if(reasons.newmail || reasons.endcharging || reasons.switchstuck || reasons.heartbeat)
+					{
+						job_next(job, NULL, NULL, NULL);
+						httpStart(onSingleRequestComplete, NULL);
+					}
 					else // Nothing to do?
 					{
 						powerOffStatus = PWROFF_SUCCESS;
@@ -619,10 +952,11 @@ static uint8_t job_process_gprsConnect(job_t* job, uint8_t action, void* data)
 					//DBG_MAIL("Rebooting...");
 					//PM_Restart();
 					
-					powerOffStatus = PWROFF_FAILURE;
-					job_next(job, &job_gsmDisconnect, NULL, NULL);
+					// Also ends up here from the bugLockout in gprs.c
+					gprsFailed(job);
 				}
 			}
+				break;
 			default:
 				break;
 		}
@@ -631,6 +965,65 @@ static uint8_t job_process_gprsConnect(job_t* job, uint8_t action, void* data)
 	return 0;
 }
 
+static uint8_t gpsOn;
+static millis_t gpsOnSince;
+static millis_t gpsOnTime; // Total time the GPS has been on for, not including the current on period
+static millis_t gpsTrackStart;
+static millis_t gpsFixTime; // Last time a good enough fix came in, 0 = never
+static millis_t trackSampleTime;
+static struct minmea_time gpsStaleRmc; // Sentence times from before the GPS was turned on
+static struct minmea_time gpsStaleGga;
+
+static void gpsPower(uint8_t on)
+{
+	if(on == gpsOn)
+		return;
+	gpsOn = on;
+
+	if(on)
+	{
+		DBG_MAIL("GPS on");
+		GPS_Info_t* gpsInfo = Gps_GetInfo();
+		gpsStaleRmc = gpsInfo->rmc.time;
+		gpsStaleGga = gpsInfo->gga.time;
+		freq_begin(FREQ_PHASE_GPS);
+		GPS_Open(NULL);
+		GPIO_Set(GPIO_PIN9, GPIO_LEVEL_HIGH); // Turn GPS antenna on
+		led_rate(LED_GPS, LED_RATE_GPS_NOFIX);
+		gpsOnSince = millis();
+	}
+	else
+	{
+		GPS_Close();
+		GPIO_Set(GPIO_PIN9, GPIO_LEVEL_LOW);
+		freq_end(FREQ_PHASE_GPS);
+		led_rate(LED_GPS, LED_RATE_GPS_OFF);
+		gpsOnTime += millis() - gpsOnSince;
+		DBG_MAIL("GPS off, on for %ums total", gpsOnTime);
+	}
+}
+
+static millis_t gpsOnTotal(void)
+{
+	return gpsOnTime + (gpsOn ? millis() - gpsOnSince : 0);
+}
+
+static uint8_t gpsFixGood(GPS_Info_t* gpsInfo)
+{
+	// The last fix from before the GPS was turned off is still in there until new sentences come in
+	if(!memcmp(&gpsInfo->rmc.time, &gpsStaleRmc, sizeof(gpsStaleRmc)) || !memcmp(&gpsInfo->gga.time, &gpsStaleGga, sizeof(gpsStaleGga)))
+		return 0;
+	if(!gpsInfo->rmc.valid)
+		return 0;
+	if(gpsInfo->gsa[0].fix_type < 2 && gpsInfo->gsa[1].fix_type < 2)
+		return 0;
+	if(gpsInfo->gga.satellites_tracked < GPS_MIN_SATS)
+		return 0;
+	if(gpsInfo->gga.hdop.scale == 0) // Not valid
+		return 0;
+	return (minmea_tofloat(&gpsInfo->gga.hdop) <= GPS_MAX_HDOP);
+}
+
 static uint8_t job_process_gps(job_t* job, uint8_t action, void* data)
 {
 	if(action == JOB_RUN)
@@ -638,10 +1031,13 @@ static uint8_t job_process_gps(job_t* job, uint8_t action, void* data)
 		DBG_MAIL("JOB RUN: GPS");
 
 		GPS_Init();
-		GPS_Open(NULL);
-		GPIO_Set(GPIO_PIN9, GPIO_LEVEL_HIGH); // Turn GPS antenna on
-		job_run(&job_http, NULL, NULL);
-		led_rate(LED_GPS, LED_RATE_GPS_NOFIX);
+		gpsTrackStart = millis();
+		gpsOnTime = 0;
+		gpsFixTime = 0;
+		trackSampleTime = 0;
+		track_begin();
+		gpsPower(1);
+		httpStart(NULL, NULL);
 /*
 		GPS_Info_t* gpsInfo = Gps_GetInfo();
 		PRINTD("GPS WAIT...");
@@ -692,9 +1088,16 @@ static uint8_t job_process_gps(job_t* job, uint8_t action, void* data)
 		static uint32_t timer_http;
 
 		timer_http++;
-		if(timer_http >= 1200) // JOB_UPDATE runs every 50ms, 1200 = 60 seconds
+#if GPS_DUTY_CYCLE
+		if(!gpsOn && settings.trackInterval * 20UL - timer_http <= GPS_LEAD_TIME * 20UL) // Time to start looking for a fix for the next report
+			gpsPower(1);
+#endif
+		if(timer_http >= settings.trackInterval * 20UL) // JOB_UPDATE runs every 50ms
 		{
 			timer_http = 0;
+#if !TRACK_SAMPLE_INTERVAL
+			trackSampleTime = 0; // One point per report
+#endif
 			bme280_startConvertion();
 			battVoltage = PM_Voltage(&battPercent);
 			
@@ -712,7 +1115,7 @@ static uint8_t job_process_gps(job_t* job, uint8_t action, void* data)
 			if(battUndervoltCount >= 3) // Battery too low, time to turn off
 				job_next(job, NULL, NULL, NULL);
 			else
-				job_run(&job_http, NULL, NULL); // TODO what if job is still running? not a problem at the mo, timeout is 30 seconds
+				httpStart(NULL, NULL); // Uses another instance if the last upload is still going
 		}
 	}
 	else if(action == JOB_TIMEOUT)
@@ -727,7 +1130,7 @@ static uint8_t job_process_gps(job_t* job, uint8_t action, void* data)
 			{
 				PRINTD("received GPS data,length:%d", event->param1);
 				
-#if DEBUG
+#if DEBUG && DEBUG_NMEA
 				int len = event->param1;
 				while(len > 0)
 				{
@@ -741,7 +1144,9 @@ static uint8_t job_process_gps(job_t* job, uint8_t action, void* data)
 				}
 #endif
 				
+				freq_begin(FREQ_PHASE_NMEA);
 				GPS_Update(event->pParam1, event->param1);
+				freq_end(FREQ_PHASE_NMEA);
 				//Trace(1, "GPSUPDT END");
 
 				GPS_Info_t* gpsInfo = Gps_GetInfo();
@@ -749,16 +1154,21 @@ static uint8_t job_process_gps(job_t* job, uint8_t action, void* data)
 					led_rate(LED_GPS, LED_RATE_GPS_FIX);
 				else
 					led_rate(LED_GPS, LED_RATE_GPS_NOFIX);
-				
-				// A9G has another bug where if both UART1 and UART2 receive data at the same time their buffers get all messed up
-				// It looks like they both share the same buffer???
-				// A work around is to run the info request job straight after receiving data from the GPS module
-				static uint32_t timer_req;
-				timer_req++;
-				if(timer_req >= 2) // Run every 2 seconds (GPS data comes in every 1 second)
+
+				if(job->running && gpsOn && gpsFixGood(gpsInfo))
 				{
-					timer_req = 0;
-					job_next(NULL, &job_requestInfo, NULL, NULL);
+					gpsFixTime = millis();
+
+					if(trackSampleTime == 0 || (TRACK_SAMPLE_INTERVAL && millis() - trackSampleTime >= TRACK_SAMPLE_INTERVAL * 1000UL))
+					{
+						trackSampleTime = millis();
+						track_add(minmea_tocoord(&gpsInfo->rmc.latitude), minmea_tocoord(&gpsInfo->rmc.longitude));
+					}
+#if GPS_DUTY_CYCLE
+					// Got what we need for the next report, it'll be turned back on GPS_LEAD_TIME before the one after
+					if(settings.trackInterval > GPS_LEAD_TIME)
+						gpsPower(0);
+#endif
 				}
 			}
 				break;
@@ -768,9 +1178,8 @@ static uint8_t job_process_gps(job_t* job, uint8_t action, void* data)
 	}
 	else if(action == JOB_STOP)
 	{
-		GPS_Close();
-		GPIO_Set(GPIO_PIN9, GPIO_LEVEL_LOW);
-		led_rate(LED_GPS, LED_RATE_GPS_OFF);
+		gpsPower(0);
+		track_end();
 		powerOffStatus = PWROFF_SUCCESS;
 		job_next(NULL, &job_gprsDisconnect, NULL, NULL);
 		// TODO what if HTTP job is still running?
@@ -779,43 +1188,259 @@ static uint8_t job_process_gps(job_t* job, uint8_t action, void* data)
 	return 0;
 }
 
-static uint8_t job_process_http(job_t* job, uint8_t action, void* data)
+static void commandsApply(cmd_t* cmd)
+{
+	// Commands from the server, only saved if something actually changed to save wearing out the flash
+	settings_t old = settings;
+	int32_t value;
+
+	if(cmd_get(cmd, CMD_TRACKINTERVAL, &value))
+	{
+		if(value < 10)
+			value = 10;
+		else if(value > 3600)
+			value = 3600;
+		settings.trackInterval = value;
+	}
+
+	if(cmd_get(cmd, CMD_BALANCE, &value))
+		settings.balForce = (value != 0);
+
+	if(cmd_get(cmd, CMD_ENCODING, &value) && (value == SETTINGS_ENCODING_FULL || value == SETTINGS_ENCODING_COMPACT))
+		settings.encoding = value;
+
+	if(cmd_get(cmd, CMD_HEARTBEAT, &value) && value >= 0 && value <= 31)
+	{
+		settings.heartbeat = value;
+		if(settings.heartbeat != old.heartbeat)
+			mailcomm_heartbeat(settings.heartbeat);
+	}
+
+	if(memcmp(&old, &settings, sizeof(settings)) != 0)
+	{
+		DBG_MAIL("New settings: enc %u, hb %u, bal %u, ti %u", settings.encoding, settings.heartbeat, settings.balForce, settings.trackInterval);
+		settings_save();
+	}
+}
+
+static void httpInit(void)
+{
+	// Seed the retry jitter from the IMEI so a fleet of mailboxes that all powered up together still spread out
+	uint8_t imei[16];
+	memset(imei, 0, sizeof(imei));
+	INFO_GetIMEI(imei);
+	uint32_t seed = 2166136261UL;
+	for(uint8_t i=0;i<sizeof(imei) && imei[i];i++)
+		seed = (seed ^ imei[i]) * 16777619UL;
+	srand(seed ^ millis());
+
+	for(uint8_t i=0;i<HTTP_INSTANCES;i++)
+	{
+		job_http[i].timeout = HTTP_TIMEOUT;
+		job_http[i].maxReties = HTTP_RETRIES;
+		job_http[i].onProcess = job_process_http;
+		job_http[i].ctx = &httpCtx[i];
+		httpCtx[i].id = i;
+	}
+}
+
+static void httpSocketOpen(httpCtx_t* ctx, int fd)
+{
+	httpSockets[ctx->id].fd = fd;
+	httpSockets[ctx->id].closing = 0;
+	ctx->fd = fd;
+}
+
+static void httpSocketClose(httpCtx_t* ctx)
+{
+	// The instance forgets about the socket now, anything else for it is swallowed by httpEvent() until it's closed
+	// NOTE: API_EVENT_ID_SOCKET_CLOSED will be queued up and arrive after we've returned
+	httpSocket_t* skt = &httpSockets[ctx->id];
+	skt->closing = 1;
+	skt->closeTime = millis();
+	http_close(ctx->fd);
+	ctx->fd = 0;
+}
+
+static uint8_t httpSocketBusy(uint8_t id)
+{
+	httpSocket_t* skt = &httpSockets[id];
+	if(skt->fd != 0 && skt->closing && millis() - skt->closeTime >= HTTP_CLOSE_TIMEOUT)
+	{
+		DBG_HTTP("[%u] skt %d never closed", id, skt->fd);
+		skt->fd = 0;
+	}
+	return (skt->fd != 0);
+}
+
+static httpSocket_t* httpSocketFind(int fd, uint8_t closing)
+{
+	for(uint8_t i=0;i<HTTP_INSTANCES;i++)
+	{
+		if(httpSockets[i].fd != 0 && httpSockets[i].fd == fd && httpSockets[i].closing == closing)
+			return &httpSockets[i];
+	}
+	return NULL;
+}
+
+static void httpEvent(API_Event_t* event)
+{
+	switch(event->id)
+	{
+		case API_EVENT_ID_SOCKET_CONNECTED:
+		case API_EVENT_ID_SOCKET_RECEIVED:
+		case API_EVENT_ID_SOCKET_SENT:
+		case API_EVENT_ID_SOCKET_CLOSED:
+		case API_EVENT_ID_SOCKET_ERROR:
+		{
+			// A socket that's closing gets first go, anything for it was queued up before the fd could be given out again
+			httpSocket_t* skt = httpSocketFind(event->param1, 1);
+			if(skt != NULL)
+			{
+				if(event->id == API_EVENT_ID_SOCKET_CLOSED)
+				{
+					DBG_HTTP("[%u] skt closed %d", (uint8_t)(skt - httpSockets), skt->fd);
+					skt->fd = 0;
+				}
+				break;
+			}
+
+			skt = httpSocketFind(event->param1, 0);
+			if(skt != NULL)
+				job_process_http(&job_http[skt - httpSockets], JOB_EVENT, event);
+		}
+			break;
+		default:
+			for(uint8_t i=0;i<HTTP_INSTANCES;i++)
+				job_process_http(&job_http[i], JOB_EVENT, event);
+			break;
+	}
+}
+
+static uint8_t httpStart(onComplete_t onComplete, void* onCompleteParam)
+{
+	// Instances still waiting for their old socket to close can't be used yet
+	job_t* job = NULL;
+	for(uint8_t i=0;i<HTTP_INSTANCES;i++)
+	{
+		if(!job_http[i].running && !httpSocketBusy(i))
+		{
+			job = &job_http[i];
+			break;
+		}
+	}
+
+	if(job == NULL)
+	{
+		DBG_MAIL("HTTP: All instances busy");
+		return 0;
+	}
+
+	job_run(job, onComplete, onCompleteParam);
+	return 1;
+}
+
+static void httpFailed(job_t* job)
+{
+	httpCtx_t* ctx = job->ctx;
+
+	// Connection failed or dropped before we got a response, try again while GPRS is still up.
+	// Much quicker than powering off and having the MCU reboot us to register with the network all over again.
+	if(job->retries < job->maxReties && gprs_isActive())
+	{
+		// Random extra delay so a fleet of mailboxes doesn't all retry at the same time after a server outage
+		ctx->retryDelay = HTTP_RETRY_DELAY << job->retries;
+		ctx->retryDelay += rand() % ctx->retryDelay;
+
+		// No point starting a retry the MCU will cut the power in the middle of, better to let it see the failure and power cycle us
+		// Tracking mode has no MCU timeout
+		if(!reasons.trackMode && millis() + ctx->retryDelay + HTTP_RETRY_TIMEOUT > HTTP_DEADLINE)
+		{
+			DBG_HTTP("[%u] No time left to retry", ctx->id);
+			track_release(ctx->id);
+			job_next(job, NULL, NULL, NULL);
+			if(job->onComplete != NULL)
+				job->onComplete(job->onCompleteParam, 0);
+			return;
+		}
+
+		job->retries++;
+		job->timeout = HTTP_RETRY_TIMEOUT;
+		DBG_HTTP("[%u] Retry %u in %ums", ctx->id, job->retries, ctx->retryDelay);
+
+		job->running = 1; // Might have come from a timeout
+		job->startTime = millis();
+		ctx->retryWait = 1;
+		return;
+	}
+
+	// Points in the failed upload can go in the next one from either instance
+	track_release(ctx->id);
+	job_next(job, NULL, NULL, NULL);
+	if(job->onComplete != NULL)
+		job->onComplete(job->onCompleteParam, 0);
+}
+
+static void balanceLoad(void)
+{
+	// Balance reply that arrived too late for the last report
+	uint8_t get = smsBalance.get;
+	if(settings_readFile(BALANCE_FILE, &smsBalance, sizeof(smsBalance)))
+	{
+		DBG_MAIL("Late balance: %s", smsBalance.content);
+		smsBalance.state = SMSBAL_LATE;
+		balanceLate = 1;
+	}
+	smsBalance.get = get;
+}
+
+static void balanceSent(void)
 {
-	// WARNING: Do not run this job again if it is still running, things will probably get super messed up
+	if(balanceLate)
+	{
+		balanceLate = 0;
+		API_FS_Delete(BALANCE_FILE);
+	}
+}
 
-	static char jsonRes[16];
-	static uint8_t requestSuccessful;
+static uint8_t job_process_http(job_t* job, uint8_t action, void* data)
+{
+	// Each instance has its own state in ctx, they can all be running at the same time
+	httpCtx_t* ctx = job->ctx;
 
 	if(action == JOB_RUN)
 	{
-		DBG_MAIL("JOB RUN: HTTP");
-		fd_http_closing = 0;
-		memset(jsonRes, '\0', sizeof(jsonRes));
-		requestSuccessful = 0;
-		http_begin();
+		DBG_MAIL("JOB RUN: HTTP %u", ctx->id);
+		job->timeout = HTTP_TIMEOUT;
+		ctx->trackId = 0;
+		ctx->retryWait = 0;
+		http_responseBegin(&ctx->resp);
+		ctx->successful = 0;
+		http_begin(ctx->id);
 	}
 	else if(action == JOB_UPDATE)
 	{
+		// Old socket has to be gone before opening another one
+		if(ctx->retryWait && millis() - job->startTime >= ctx->retryDelay && !httpSocketBusy(ctx->id))
+		{
+			DBG_MAIL("JOB RETRY: HTTP %u", ctx->id);
+			ctx->retryWait = 0;
+			job->startTime = millis();
+			http_responseBegin(&ctx->resp);
+			http_begin(ctx->id);
+		}
 	}
 	else if(action == JOB_TIMEOUT)
 	{
 		// TODO reset job timeout on receive
 
-		DBG_MAIL("JOB TO: HTTP");
+		DBG_MAIL("JOB TO: HTTP %u", ctx->id);
 		DBG_HTTP("TIMEOUT, closing");
 
-		if(fd_http > 0) // fs_http could be 0 if we timeout while waiting for a DNS response
-		{
-			// NOTE: When http_close() is called the main task might interrupt this task with the API_EVENT_ID_SOCKET_CLOSED event
-			fd_http_closing = 1;
-			http_close(fd_http);
-		}
+		if(ctx->fd > 0) // fd could be 0 if we timeout while waiting for a DNS response
+			httpSocketClose(ctx);
 
-		job_next(job, NULL, NULL, NULL);
-		if(job->onComplete != NULL)
-			job->onComplete(job->onCompleteParam, 0);
-		
-		// TODO retry
+		httpFailed(job);
 	}
 	else if(action == JOB_EVENT)
 	{
@@ -825,39 +1450,39 @@ static uint8_t job_process_http(job_t* job, uint8_t action, void* data)
 			case MAILBOX_EVT_HTTP_BEGIN:
 			{
 				// If timeout occurs while doing a DNS lookup and then DNS returns a response after the timeout things will go wonky
-				if(!job->running)
+				if(event->param1 != ctx->id || !job->running || ctx->retryWait)
 					break;
 				
-				int res = http_host(HTTP_HOST, HTTP_PORT);
+				freq_begin(FREQ_PHASE_SOCKET);
+				int res = http_host(ctx->id, HTTP_HOST, HTTP_PORT);
+				freq_end(FREQ_PHASE_SOCKET);
 				if(res > 0)
-					fd_http = res;
+					httpSocketOpen(ctx, res);
 				else if(res < 0) // Failure
-				{
-					job_next(job, NULL, NULL, NULL);
-					if(job->onComplete != NULL)
-						job->onComplete(job->onCompleteParam, 0);
-				}
+					httpFailed(job);
 				else // Waiting for a DNS response
 				{
 
 				}
 			}
 				break;
-			case MAILBOX_EVT_HTTP_DNSFAIL: // TODO what if a different DNS lookup causes the failure?
+			case MAILBOX_EVT_HTTP_DNSFAIL:
+				if(event->param1 != ctx->id || !job->running || ctx->retryWait)
+					break;
 				DBG_HTTP("DNS Error " HTTP_HOST);
-				job_next(job, NULL, NULL, NULL);
-				if(job->onComplete != NULL)
-					job->onComplete(job->onCompleteParam, 0);
+				httpFailed(job);
 				break;
 			case API_EVENT_ID_SOCKET_CONNECTED:
 			{
 				//timeoutReset(10000);
 				
-				if(event->param1 != fd_http)
+				if(event->param1 != ctx->fd)
 					break;
 				
 				DBG_HTTP("skt connected %d", event->param1);
 
+				freq_begin(FREQ_PHASE_JSON);
+
 				char ip[16];
 				Network_GetIp(ip, 16);
 				
@@ -875,6 +1500,9 @@ static uint8_t job_process_http(job_t* job, uint8_t action, void* data)
 				memset(iccid, 0, sizeof(iccid));
 				SIM_GetICCID(iccid);
 				
+				bme280_data_t env;
+				bme280_read(&env);
+
 				GPS_Info_t* gpsInfo = Gps_GetInfo();
 
 				if(gpsInfo->rmc.latitude.scale == 0)
@@ -935,52 +1563,157 @@ static uint8_t job_process_http(job_t* job, uint8_t action, void* data)
 				cJSON* bds = NULL;
 				cJSON* tracktime = NULL;
 				cJSON* trackdate = NULL;
+				cJSON* power = NULL;
+				cJSON* timing = NULL;
+				cJSON* log = NULL;
+				cJSON* telemetry = NULL;
+
+				// Server can ask for a smaller payload, it fills in anything missing from default.json
+				uint8_t compact = (settings.encoding == SETTINGS_ENCODING_COMPACT);
+
+				// Work out which of the rarely changing bits need sending
+				delta_t* delta = &ctx->delta;
+				delta_begin(delta);
+				uint32_t hash;
+				uint8_t sendFirmware = 0;
+				uint8_t sendSim = 0;
+				uint8_t sendIp = 0;
+				if(!compact)
+				{
+					hash = delta_hash(DELTA_HASH_INIT, FW_VERSION, sizeof(FW_VERSION));
+					sendFirmware = delta_changed(delta, DELTA_FIRMWARE, delta_hash(hash, fwBuild, strlen(fwBuild)));
+					sendSim = delta_changed(delta, DELTA_SIM, delta_hash(DELTA_HASH_INIT, iccid, sizeof(iccid)));
+					sendIp = delta_changed(delta, DELTA_IP, delta_hash(DELTA_HASH_INIT, ip, sizeof(ip)));
+				}
+				hash = delta_hash(DELTA_HASH_INIT, &smsBalance.state, sizeof(smsBalance.state));
+				hash = delta_hash(hash, smsBalance.content, sizeof(smsBalance.content));
+				uint8_t sendBalance = delta_changed(delta, DELTA_BALANCE, delta_hash(hash, smsBalance.dateTime, sizeof(smsBalance.dateTime)));
+				uint8_t sendSats = 0;
+				if(reasons.trackMode)
+				{
+					uint8_t sats[6] = {gpsInfo->gsa[0].fix_type, totalSats[0], trackedSats[0], gpsInfo->gsa[1].fix_type, totalSats[1], trackedSats[1]};
+					sendSats = delta_changed(delta, DELTA_SATS, delta_hash(DELTA_HASH_INIT, sats, sizeof(sats)));
+				}
 
 				root = cJSON_CreateObject();
 				cJSON_AddStringToObject(root, "key", HTTP_API_KEY);
 				cJSON_AddNumberToObject(root, "millis", millis());
-				cJSON_AddItemToObject(root, "firmware", fw = cJSON_CreateObject());
-				cJSON_AddStringToObject(fw, "version", FW_VERSION);
-				cJSON_AddStringToObject(fw, "built", fwBuild);
+				cJSON* jDelta = cJSON_CreateObject();
+				cJSON_AddNumberToObject(jDelta, "base", delta->base);
+				cJSON_AddNumberToObject(jDelta, "seq", delta->seq);
+				cJSON_AddItemToObject(root, "delta", jDelta);
+				if(sendFirmware)
+				{
+					cJSON_AddItemToObject(root, "firmware", fw = cJSON_CreateObject());
+					cJSON_AddStringToObject(fw, "version", FW_VERSION);
+					cJSON_AddStringToObject(fw, "built", fwBuild);
+				}
 				cJSON_AddItemToObject(root, "network", network = cJSON_CreateObject());
 				cJSON_AddNumberToObject(network, "signal", gsmSignal.signalLevel);
-				cJSON_AddNumberToObject(network, "biterror", gsmSignal.bitError);
-				cJSON_AddStringToObject(network, "ip", ip);
-				cJSON_AddStringToObject(network, "number", "");
-				cJSON_AddStringToObject(network, "imei", imei);
-				cJSON_AddStringToObject(network, "iccid", iccid);
+				cJSON_AddNumberToObject(network, "retries", job->retries);
+				cJSON_AddStringToObject(network, "imei", imei); // Always sent, the server keeps track of delta snapshots with it
+				if(!compact)
+				{
+					cJSON_AddNumberToObject(network, "biterror", gsmSignal.bitError);
+					if(sendIp)
+						cJSON_AddStringToObject(network, "ip", ip);
+					if(sendSim)
+					{
+						cJSON_AddStringToObject(network, "number", "");
+						cJSON_AddStringToObject(network, "iccid", iccid);
+					}
+				}
 				cJSON_AddItemToObject(root, "battery", batt = cJSON_CreateObject());
 				cJSON_AddNumberToObject(batt, "voltage", battVoltage);
 				cJSON_AddNumberToObject(batt, "percent", battPercent);
 				cJSON_AddNumberToObject(batt, "vlm", vlmDetected);
-				cJSON_AddItemToObject(root, "balance", balance = cJSON_CreateObject());
-				cJSON_AddNumberToObject(balance, "state", smsBalance.state);
-				cJSON_AddStringToObject(balance, "message", smsBalance.content);
-				cJSON_AddStringToObject(balance, "datetime", smsBalance.dateTime);
+				if(smsBalance.state == SMSBAL_PENDING)
+					balanceReported = 1;
+				if(sendBalance)
+				{
+					cJSON_AddItemToObject(root, "balance", balance = cJSON_CreateObject());
+					cJSON_AddNumberToObject(balance, "state", smsBalance.state);
+					cJSON_AddStringToObject(balance, "message", smsBalance.content);
+					cJSON_AddStringToObject(balance, "datetime", smsBalance.dateTime);
+				}
 				cJSON_AddItemToObject(root, "reasons", jReasons = cJSON_CreateObject());
 				cJSON_AddNumberToObject(jReasons, "newmail", reasons.newmail);
+				cJSON_AddNumberToObject(jReasons, "mailcount", reasons.mailcount);
 				cJSON_AddNumberToObject(jReasons, "endcharge", reasons.endcharging);
 				cJSON_AddNumberToObject(jReasons, "trackmode", reasons.trackMode);
 				cJSON_AddNumberToObject(jReasons, "switchstuck", reasons.switchstuck);
+				cJSON_AddNumberToObject(jReasons, "heartbeat", reasons.heartbeat);
+				millis_t mailAgeNow = mailAge + (millis() - mailAgeTime);
+				time_t timeNow = time(NULL);
+				cJSON_AddNumberToObject(jReasons, "mailage", mailAgeValid ? (double)mailAgeNow : -1); // Flap opening to now (ms)
+				cJSON_AddNumberToObject(jReasons, "mailtime", (mailAgeValid && timeNow >= TIME_VALID) ? (double)(timeNow - mailAgeNow / 1000) : 0); // Unix time of the flap opening from the network clock, so the server can work out how long the upload took
 				cJSON_AddItemToObject(root, "counts", jCounts = cJSON_CreateObject());
 				cJSON_AddNumberToObject(jCounts, "success", counts.success);
 				cJSON_AddNumberToObject(jCounts, "failure", counts.failure);
 				cJSON_AddNumberToObject(jCounts, "timeout", counts.timeout);
+				cJSON_AddNumberToObject(jCounts, "stuckpolls", counts.stuckPolls);
+				cJSON_AddNumberToObject(jCounts, "uptime", counts.uptime);
 				cJSON_AddItemToObject(root, "environment", environment = cJSON_CreateObject());
-				cJSON_AddNumberToObject(environment, "temperature", (bme280_readTemperature() / 100.0));
-				cJSON_AddNumberToObject(environment, "humidity", (bme280_readHumidity() / 1024.0));
-				cJSON_AddNumberToObject(environment, "pressure", ((bme280_readPressure() / 256.0) / 100.0));
+				cJSON_AddNumberToObject(environment, "temperature", (env.temperature / 100.0));
+				cJSON_AddNumberToObject(environment, "humidity", (env.humidity / 1024.0));
+				cJSON_AddNumberToObject(environment, "pressure", ((env.pressure / 256.0) / 100.0));
+				if(!compact)
+				{
+					cJSON_AddItemToObject(root, "power", power = cJSON_CreateObject()); // Time spent at each CPU frequency and in each busy phase so far (ms)
+					cJSON_AddNumberToObject(power, "governor", FREQ_GOVERNOR);
+					cJSON_AddNumberToObject(power, "high", freq_highTime());
+					cJSON_AddNumberToObject(power, "low", freq_lowTime());
+					cJSON_AddNumberToObject(power, "boot", freq_phaseTime(FREQ_PHASE_BOOT));
+					cJSON_AddNumberToObject(power, "json", freq_phaseTime(FREQ_PHASE_JSON));
+					cJSON_AddNumberToObject(power, "nmea", freq_phaseTime(FREQ_PHASE_NMEA));
+					cJSON_AddNumberToObject(power, "socket", freq_phaseTime(FREQ_PHASE_SOCKET));
+					cJSON_AddNumberToObject(power, "link", freq_phaseTime(FREQ_PHASE_LINK));
+					cJSON_AddNumberToObject(power, "gps", freq_phaseTime(FREQ_PHASE_GPS));
+					cJSON_AddItemToObject(root, "timing", timing = cJSON_CreateObject()); // Things that held up the wake (ms)
+					cJSON_AddNumberToObject(timing, "smsclear", smsClearTime);
+					cJSON_AddNumberToObject(timing, "verdict", httpVerdictTime); // Previous request
+					cJSON_AddNumberToObject(timing, "register", gsm_registerTime()); // From boot
+					cJSON_AddNumberToObject(timing, "savedplmn", gsm_usedSavedPlmn());
+					cJSON_AddItemToObject(root, "telemetry", telemetry = cJSON_CreateObject()); // Peak usage so far (bytes)
+					cJSON_AddNumberToObject(telemetry, "stacksizemain", telemetry_stackSize(TELEMETRY_TASK_MAIN));
+					cJSON_AddNumberToObject(telemetry, "stacksizemail", telemetry_stackSize(TELEMETRY_TASK_MAILBOX));
+					cJSON_AddNumberToObject(telemetry, "stackmain", telemetry_stackPeak(TELEMETRY_TASK_MAIN));
+					cJSON_AddNumberToObject(telemetry, "stackmail", telemetry_stackPeak(TELEMETRY_TASK_MAILBOX));
+					cJSON_AddNumberToObject(telemetry, "heap", telemetry_heapPeak());
+					cJSON_AddNumberToObject(telemetry, "heaptotal", telemetry_heapTotal());
+					cJSON_AddNumberToObject(telemetry, "mallocfail", telemetry_mallocFails());
+					cJSON_AddNumberToObject(telemetry, "queuedrop", evtqueue_dropped());
+					cJSON* latency = cJSON_CreateArray(); // Event dispatch latency histogram, see EVTQUEUE_BUCKETS
+					for(uint8_t i=0;i<EVTQUEUE_BUCKETS;i++)
+						cJSON_AddItemToArray(latency, cJSON_CreateNumber(evtqueue_latency(i)));
+					cJSON_AddItemToObject(telemetry, "latency", latency);
+				}
+#if LOG_RING && LOG_REPORT
+				if(job->retries) // Something went wrong, include what happened
+				{
+					char line[96];
+					cJSON_AddItemToObject(root, "log", log = cJSON_CreateArray());
+					for(uint8_t i=LOG_REPORT;i>0;i--)
+					{
+						if(logring_get(i - 1, line, sizeof(line)))
+							cJSON_AddItemToArray(log, cJSON_CreateString(line));
+					}
+				}
+#endif
 				if(reasons.trackMode)
 				{
 					cJSON_AddItemToObject(root, "track", track = cJSON_CreateObject());
-					cJSON_AddItemToObject(track, "gps", gps = cJSON_CreateObject());
-					cJSON_AddNumberToObject(gps, "fix", gpsInfo->gsa[0].fix_type);
-					cJSON_AddNumberToObject(gps, "sattotal", totalSats[0]);
-					cJSON_AddNumberToObject(gps, "sattrack", trackedSats[0]);
-					cJSON_AddItemToObject(track, "bds", bds = cJSON_CreateObject());
-					cJSON_AddNumberToObject(bds, "fix", gpsInfo->gsa[1].fix_type); // NOTE: fix_type for both GPS and BDS are always the same value, if we have a GPS fix then BDS will also say it has a fix, even when it can't see any BDS satellites
-					cJSON_AddNumberToObject(bds, "sattotal", totalSats[1]);
-					cJSON_AddNumberToObject(bds, "sattrack", trackedSats[1]);
+					if(sendSats)
+					{
+						cJSON_AddItemToObject(track, "gps", gps = cJSON_CreateObject());
+						cJSON_AddNumberToObject(gps, "fix", gpsInfo->gsa[0].fix_type);
+						cJSON_AddNumberToObject(gps, "sattotal", totalSats[0]);
+						cJSON_AddNumberToObject(gps, "sattrack", trackedSats[0]);
+						cJSON_AddItemToObject(track, "bds", bds = cJSON_CreateObject());
+						cJSON_AddNumberToObject(bds, "fix", gpsInfo->gsa[1].fix_type); // NOTE: fix_type for both GPS and BDS are always the same value, if we have a GPS fix then BDS will also say it has a fix, even when it can't see any BDS satellites
+						cJSON_AddNumberToObject(bds, "sattotal", totalSats[1]);
+						cJSON_AddNumberToObject(bds, "sattrack", trackedSats[1]);
+					}
 					cJSON_AddNumberToObject(track, "quality", gpsInfo->gga.fix_quality);
 					cJSON_AddNumberToObject(track, "sattrack", gpsInfo->gga.satellites_tracked); // Total satellites tracked for all constellations, GSA messages can only have up to 12 satellites, but up to 16 can be in view at once
 					cJSON_AddNumberToObject(track, "latitude", latitude);
@@ -997,6 +1730,34 @@ static uint8_t job_process_http(job_t* job, uint8_t action, void* data)
 					cJSON_AddNumberToObject(tracktime, "m", gpsInfo->rmc.time.minutes);
 					cJSON_AddNumberToObject(tracktime, "s", gpsInfo->rmc.time.seconds);
 					cJSON_AddNumberToObject(tracktime, "ms", gpsInfo->rmc.time.microseconds / 1000);
+					millis_t trackTime = millis() - gpsTrackStart;
+					cJSON_AddNumberToObject(track, "fixage", gpsFixTime ? (int32_t)(millis() - gpsFixTime) : -1); // ms
+					cJSON_AddNumberToObject(track, "gpson", trackTime ? (gpsOnTotal() * 100ULL) / trackTime : 100); // % of the time since tracking started
+
+					// Oldest simplified track points that haven't been acknowledged yet, [lat, lon, age in seconds], lat/lon are degrees * 100000
+					// Age is -1 if the point was recorded before the network set the clock
+					// Empty if the other instance has the batch out already
+					track_flush();
+					cJSON* points = cJSON_CreateArray();
+					uint8_t count;
+					const track_point_t* batch = track_batch(ctx->id, &count);
+					uint32_t now = time(NULL);
+					ctx->trackId = 0;
+					for(uint8_t i=0;i<count;i++)
+					{
+						cJSON* p = cJSON_CreateArray();
+						cJSON_AddItemToArray(p, cJSON_CreateNumber(batch[i].lat));
+						cJSON_AddItemToArray(p, cJSON_CreateNumber(batch[i].lon));
+						cJSON_AddItemToArray(p, cJSON_CreateNumber((batch[i].time && now >= TIME_VALID) ? (int32_t)(now - batch[i].time) : -1));
+						cJSON_AddItemToArray(points, p);
+						ctx->trackId = batch[i].id;
+					}
+					cJSON_AddItemToObject(track, "points", points);
+					cJSON_AddNumberToObject(track, "ptsin", track_in()); // Compression ratio is ptsout / ptsin
+					cJSON_AddNumberToObject(track, "ptsout", track_out());
+					cJSON_AddNumberToObject(track, "qdepth", track_queued()); // Points still waiting in the flash queue after this report
+					cJSON_AddNumberToObject(track, "qdrained", track_drained()); // Total points uploaded from the flash queue
+					cJSON_AddNumberToObject(track, "qlost", track_lost());
 				}
 
 				// malloc a ~2K buffer for JSON and HTTP header (cJSON_PrintPreallocated()) so that the entire HTTP request can be sent in a single packet.
@@ -1010,9 +1771,11 @@ static uint8_t job_process_http(job_t* job, uint8_t action, void* data)
 				#define HTTP_BODY_MAXLEN	1792
 
 				char* httpReqBuff = malloc(HTTP_HDR_MAXLEN + HTTP_BODY_MAXLEN);
+				telemetry_heapSample(); // Biggest allocation, plus all of the cJSON nodes
 
 				int success = cJSON_PrintPreallocated(root, httpReqBuff + HTTP_HDR_MAXLEN, HTTP_BODY_MAXLEN, 0);
 				cJSON_Delete(root);
+				freq_end(FREQ_PHASE_JSON);
 				
 				if(success)
 				{
@@ -1035,7 +1798,10 @@ static uint8_t job_process_http(job_t* job, uint8_t action, void* data)
 					// Move body to the end of the headers
 					memmove(headers, httpReqBuff + HTTP_HDR_MAXLEN, len);
 					
-					int writeLen = http_send(fd_http, httpReqBuff, len + headerLen);
+					freq_begin(FREQ_PHASE_SOCKET);
+					int writeLen = http_send(ctx->fd, httpReqBuff, len + headerLen);
+					freq_end(FREQ_PHASE_SOCKET);
+					ctx->sentTime = millis();
 					DBG_HTTP("Wrote %d", writeLen);
 				}
 				else
@@ -1046,75 +1812,80 @@ static uint8_t job_process_http(job_t* job, uint8_t action, void* data)
 				break;
 			case API_EVENT_ID_SOCKET_RECEIVED:
 			{
-				if(event->param1 == fd_http)
+				if(event->param1 == ctx->fd)
 				{
 					DBG_HTTP("skt recv %d, len %d", event->param1, event->param2);
 					
-					// TODO force close after 128 bytes?
-
 					char buff[128];
 					int len;
-					while((len = http_read(fd_http, buff, sizeof(buff) - 1)) > 0)
+					uint8_t verdict = HTTP_VERDICT_PENDING;
+					freq_begin(FREQ_PHASE_SOCKET);
+					while(verdict == HTTP_VERDICT_PENDING && (len = http_read(ctx->fd, buff, sizeof(buff) - 1)) > 0)
 					{
 						buff[len] = '\0';
 						PRINTD("%s", buff);
 						
-						uint8_t jsonResLen = strlen(jsonRes);
-						if(!requestSuccessful && jsonResLen < sizeof(jsonRes) - 1)
+						// Response is parsed as it arrives, {"result":"ok"} with an optional "cmd" object (see cmd.h)
+						verdict = http_responseFeed(&ctx->resp, buff, len);
+					}
+					freq_end(FREQ_PHASE_SOCKET);
+
+					if(verdict != HTTP_VERDICT_PENDING)
+					{
+						// Got everything we need, no point waiting around for the server to close the connection
+						httpVerdictTime = millis() - ctx->sentTime;
+						ctx->successful = (verdict == HTTP_VERDICT_OK);
+						DBG_HTTP("[%u] Verdict %u after %ums", ctx->id, verdict, httpVerdictTime);
+
+						httpSocketClose(ctx);
+
+						if(ctx->successful)
 						{
-							// Super simple response parsing
-							// Look for a '{' character then check to see if the next 14 characters are '"result":"ok"}'
-							char* jsonStart = (jsonResLen == 0) ? strchr(buff, '{') : buff;
-							if(jsonStart != NULL)
-							{
-								strncpy(jsonRes + jsonResLen, jsonStart, sizeof(jsonRes) - jsonResLen);
-								jsonRes[sizeof(jsonRes) - 1] = '\0';
-								if(strcmp(jsonRes, "{\"result\":\"ok\"}") == 0)
-									requestSuccessful = 1;
-							}
+							commandsApply(&ctx->resp.cmd);
+							balanceSent();
+
+							int32_t value;
+							if(cmd_get(&ctx->resp.cmd, CMD_RESYNC, &value) && value)
+								delta_resync();
+							else
+								delta_acked(&ctx->delta);
+
+							if(ctx->trackId)
+								track_ack(ctx->trackId);
 						}
+						track_release(ctx->id);
+						job_next(job, NULL, NULL, NULL);
+						if(job->onComplete != NULL)
+							job->onComplete(job->onCompleteParam, ctx->successful);
+
+						// Back in coverage with a backlog, send the next batch straight away instead of waiting for the next report
+						if(ctx->successful && ctx->trackId && reasons.trackMode && track_queued())
+							httpStart(NULL, NULL);
 					}
 				}
 			}
 				break;
 			case API_EVENT_ID_SOCKET_SENT:
-				if(event->param1 == fd_http)
+				if(event->param1 == ctx->fd)
 					DBG_HTTP("skt sent %d", event->param1);
 				break;
 			case API_EVENT_ID_SOCKET_CLOSED:
-				if(event->param1 == fd_http)
+				if(event->param1 == ctx->fd)
 				{
+					// Server closed the connection before sending a result (we close it ourselves when we get one)
 					DBG_HTTP("skt closed %d", event->param1);
-					if(!fd_http_closing)
-					{
-						http_close(fd_http);
-						job_next(job, NULL, NULL, NULL);
-						if(job->onComplete != NULL)
-							job->onComplete(job->onCompleteParam, requestSuccessful);
-						
-						// TODO retry
-					}
-					fd_http = 0;
-					fd_http_closing = 0;
+					http_close(ctx->fd);
+					httpSockets[ctx->id].fd = 0;
+					ctx->fd = 0;
+					httpFailed(job);
 				}
 				break;
 			case API_EVENT_ID_SOCKET_ERROR:
-				if(event->param1 == fd_http)
+				if(event->param1 == ctx->fd)
 				{
 					DBG_HTTP("skt error %d, cause: %d", event->param1, event->param2);
-					if(!fd_http_closing)
-					{
-						// NOTE: When http_close() is called the main task might interrupt this task with the API_EVENT_ID_SOCKET_CLOSED event
-						// Or maybe not? API_EVENT_ID_SOCKET_ERROR is already called from main task
-						fd_http_closing = 1;
-						http_close(fd_http);
-						
-						job_next(job, NULL, NULL, NULL);
-						if(job->onComplete != NULL)
-							job->onComplete(job->onCompleteParam, 0);
-					}
-					
-					// TODO retry
+					httpSocketClose(ctx);
+					httpFailed(job);
 				}
 				break;
 			default:
@@ -1199,7 +1970,13 @@ static uint8_t job_process_requestPoweroff(job_t* job, uint8_t action, void* dat
 {
 	if(action == JOB_RUN)
 	{
-		mailcomm_poweroff(powerOffStatus);
+		if(shutdownHeld)
+		{
+			DBG_MAIL("Power off waiting for SMS");
+			poweroffWaiting = 1;
+		}
+		else
+			requestPoweroff();
 	}
 	else if(action == JOB_UPDATE)
 	{
@@ -1208,7 +1985,6 @@ static uint8_t job_process_requestPoweroff(job_t* job, uint8_t action, void* dat
 	{
 		DBG_MAIL("JOB TO: PWR OFF");
 		// Wait for MCU timeout failure...
-		// TODO go to 32k low power mode?
 		// retry?
 		// shutdown?
 	}
@@ -1219,25 +1995,70 @@ static uint8_t job_process_requestPoweroff(job_t* job, uint8_t action, void* dat
 	return 0;
 }
 
-static void update(void)
+static uint8_t job_process_linkTest(job_t* job, uint8_t action, void* data)
 {
-	for(uint8_t i=0;i<sizeof(jobs) / sizeof(job_t*);i++)
+	// Only used when MAILCOMM_LINKTEST is enabled, results are printed by mailcomm
+	if(action == JOB_RUN)
+	{
+		DBG_MAIL("JOB RUN: LINK TEST");
+		mailcomm_linkTest();
+	}
+	else if(action == JOB_UPDATE)
+	{
+	}
+	else if(action == JOB_TIMEOUT)
+	{
+		DBG_MAIL("JOB TO: LINK TEST");
+		powerOffStatus = PWROFF_FAILURE;
+		job_next(job, &job_requestPoweroff, NULL, NULL);
+	}
+	else if(action == JOB_EVENT)
 	{
-		if(jobs[i]->running)
+		API_Event_t* event = (API_Event_t*)data;
+		switch(event->id)
 		{
-			if(jobs[i]->timeout != 0 && millis() - jobs[i]->startTime > jobs[i]->timeout)
-			{
-				DBG_MAIL("JOB TIMEOUT! %u %u", i, jobs[i]->timeout);
-				jobs[i]->running = 0;
-				if(jobs[i]->onProcess != NULL)
-					jobs[i]->onProcess(jobs[i], JOB_TIMEOUT, NULL);
-			}
-			else if(jobs[i]->onProcess != NULL)
-				jobs[i]->onProcess(jobs[i], JOB_UPDATE, NULL);
+			case MAILBOX_EVT_MAILCOMM_LINKTEST:
+				DBG_MAIL("JOB EVT: LINK TEST DONE");
+				if(job->running)
+				{
+					powerOffStatus = PWROFF_SUCCESS;
+					job_next(job, &job_requestPoweroff, NULL, NULL);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	
+	return 0;
+}
+
+static void job_update(job_t* job)
+{
+	if(job->running)
+	{
+		if(job->timeout != 0 && millis() - job->startTime > job->timeout)
+		{
+			DBG_MAIL("JOB TIMEOUT! %p %u", (void*)job, job->timeout);
+			job->running = 0;
+			if(job->onProcess != NULL)
+				job->onProcess(job, JOB_TIMEOUT, NULL);
 		}
+		else if(job->onProcess != NULL)
+			job->onProcess(job, JOB_UPDATE, NULL);
 	}
+}
 
+static void update(void)
+{
+	for(uint8_t i=0;i<sizeof(jobs) / sizeof(job_t*);i++)
+		job_update(jobs[i]);
+	for(uint8_t i=0;i<HTTP_INSTANCES;i++)
+		job_update(&job_http[i]);
+
+	shutdownCheck();
 	led_update();
+	mailcomm_update();
 /*
 	static uint8_t tickCount;
 	tickCount++;
@@ -1248,7 +2069,7 @@ static void update(void)
 	//if(ledFlash == GPIO_LEVEL_HIGH)
 	//	SMS_ListMessageRequst(SMS_STATUS_ALL, SMS_STORAGE_SIM_CARD);
 
-	//printStackHeap();
+	telemetry_heapSample();
 }
 
 static void tmr_tick(void* param)
@@ -1264,12 +2085,24 @@ static void eventDispatch(API_Event_t* pEvent)
     switch(pEvent->id)
     {
 		case MAILBOX_EVT_BEGIN:
-			PM_SetSysMinFreq(PM_SYS_FREQ_13M);
-			//PM_SleepMode(true);
 			//OS_Sleep(10000);
 			//PM_ShutDown();
 			battVoltage = PM_Voltage(&battPercent);
-			job_run(&job_clearSMSs, NULL, NULL);
+			balanceLoad();
+#if MAILCOMM_LINKTEST
+			job_run(&job_linkTest, NULL, NULL);
+#else
+			smsClearTime = millis();
+			if(sms_storageNearlyFull())
+				job_run(&job_clearSMSs, onBootSMSsCleared, NULL);
+			else
+			{
+				smsClearTime = millis() - smsClearTime;
+				job_run(&job_environmentData, NULL, NULL);
+			}
+#endif
+			// Jobs are now just waiting for things to happen
+			freq_end(FREQ_PHASE_BOOT);
 			//job_run(&job_gps, NULL, NULL);
             break;
 		case MAILBOX_EVENT_GSM_LOST:
@@ -1288,6 +2121,9 @@ static void eventDispatch(API_Event_t* pEvent)
 			break;
 		case MAILBOX_EVT_HTTPREADY:
 			break;
+		case MAILBOX_EVT_MAILCOMM_RESPONSE:
+			statusUpdate();
+			break;
         default:
             break;
     }
@@ -1298,6 +2134,7 @@ static void eventDispatch(API_Event_t* pEvent)
 		if(jobs[i]->onProcess != NULL)
 			jobs[i]->onProcess(jobs[i], JOB_EVENT, pEvent);
 	}
+	httpEvent(pEvent);
 }
 
 void mailbox_eventDispatch(API_Event_t* event)
@@ -1305,7 +2142,9 @@ void mailbox_eventDispatch(API_Event_t* event)
 //	if(event->id != TRK_EVENT_TICK)
 //		PRINTD("%p %u %u %u %p %p", (void*)event, event->id, event->param1, event->param2, (void*)event->pParam1, (void*)event->pParam1);
 
-	if(event->id != TRK_EVENT_TICK)
+	if(event->id == MAILBOX_EVT_QUEUE)
+		return; // Just a wake up, the queue is drained by mailbox_task()
+	else if(event->id != TRK_EVENT_TICK)
 		eventDispatch(event);
 	else
 		update();
@@ -1322,13 +2161,34 @@ void mailbox_eventDispatch(API_Event_t* event)
 //		PRINTD("evt end %u", event->id);
 }
 
+// Called from the main task, returns false if the event was dropped and still needs freeing
+bool mailbox_forwardEvent(API_Event_t* event)
+{
+	bool wake;
+	if(!evtqueue_push(event, &wake))
+		return false;
+	if(wake)
+		mail_sendEvent(MAILBOX_EVT_QUEUE, 0, 0, NULL, NULL);
+	return true;
+}
+
+static void freeEvent(API_Event_t* event)
+{
+	OS_Free(event->pParam1);
+	OS_Free(event->pParam2);
+	OS_Free(event);
+}
+
 void mailbox_task(void *pData)
 {
-	mailboxTaskHandle = *(HANDLE*)pData;
+	// pData isn't used for the handle, OS_CreateTask() might not have returned and stored it yet
+	mailboxTaskHandle = OS_GetCurrentTask();
+	telemetry_taskStart(TELEMETRY_TASK_MAILBOX);
 	API_Event_t* event = NULL;
 
 	sms_listCallback(callback_smsList);
 	sms_newMessageCallback(callback_smsNewMessage);
+	httpInit();
 
 	tmr_tick(NULL);
 
@@ -1337,9 +2197,15 @@ void mailbox_task(void *pData)
         if(OS_WaitEvent(mailboxTaskHandle, (void**)&event, OS_TIME_OUT_WAIT_FOREVER))
         {
 			mailbox_eventDispatch(event);
-			OS_Free(event->pParam1);
-			OS_Free(event->pParam2);
-			OS_Free(event);
+			freeEvent(event);
+
+			// Also drained on every tick, so a wake up that raced with the last pop only delays things by a tick
+			API_Event_t* sdkEvent;
+			while((sdkEvent = evtqueue_pop()) != NULL)
+			{
+				mailbox_eventDispatch(sdkEvent);
+				freeEvent(sdkEvent);
+			}
         }
 	}
 }
@@ -1356,6 +2222,8 @@ void mail_sendEvent(uint32_t id, uint32_t param1, uint32_t param2, void* pParam1
 		event->pParam2 = pParam2;
 		OS_SendEvent(mailboxTaskHandle, event, OS_WAIT_FOREVER, OS_EVENT_PRI_NORMAL);
 	}
+	else
+		telemetry_mallocFailed();
 }
 
 millis_t millis()
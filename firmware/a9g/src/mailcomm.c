@@ -8,57 +8,324 @@
 
 #include "common.h"
 
-#define BUFF_LEN (8 + 1) // 1 extra for loopback
-static char buff[BUFF_LEN];
-static uint8_t buffIdx;
+static uint8_t buff[MAIL_COMM_FRAME_LEN]; // Frame being received
+static uint8_t buffIdx; // 0 = not in a frame
+static uint8_t frame[MAIL_COMM_FRAME_LEN]; // Last good status frame
+static uint8_t echoSkip; // Number of our own bytes still to come back from the loopback
+static uint8_t replyCmd; // Byte we sent that is waiting for a 1 byte reply, 0 = not waiting
+static uint8_t replyWait;
+static uint8_t idleTicks;
+static uint8_t versionWarned;
+
+#define REPLY_TIMEOUT		4 // Ticks (50ms each) to wait for a 1 byte reply
+#define FRAME_TIMEOUT		2 // Ticks (50ms each) of silence before dropping a partial frame
+
+#define LINKTEST_COUNT		100 // Number of echo bytes to send at each baud rate
+#define LINKTEST_TIMEOUT	REPLY_TIMEOUT // Ticks to wait for an echo reply before counting it as lost
+
+typedef struct {
+	uint16_t ok;
+	uint16_t bad;
+	uint16_t lost;
+	uint16_t errors;
+} linkTestResult_t;
+
+static const UART_Baud_Rate_t baudRates[MAIL_COMM_BAUD_COUNT] = {
+	UART_BAUD_RATE_9600,
+	UART_BAUD_RATE_19200,
+	UART_BAUD_RATE_38400,
+	UART_BAUD_RATE_57600,
+	UART_BAUD_RATE_115200
+};
+
+static uint8_t baudIdx;
+static uint8_t baudFailed; // Don't try to negotiate again after a fallback
+
+static uint8_t linkTestRunning;
+static uint8_t linkTestBaud;
+static uint16_t linkTestSent;
+static uint8_t linkTestWait;
+static uint8_t linkTestPause;
+static uint8_t linkTestExpect;
+static linkTestResult_t linkTestResults[MAIL_COMM_BAUD_COUNT];
+
+static void uartError(UART_Error_t error)
+{
+	// Might not be called from the mailbox task
+	mail_sendEvent(MAILBOX_EVT_MAILCOMM_ERROR, error, 0, NULL, NULL);
+}
+
+static void uartInit(uint8_t baud)
+{
+	// UART1 for MCU comms
+	UART_Config_t uartConfig = {
+		.baudRate = baudRates[baud],
+		.dataBits = UART_DATA_BITS_8,
+		.stopBits = UART_STOP_BITS_1,
+		.parity   = UART_PARITY_NONE,
+		.rxCallback = NULL,
+		.errorCallback = uartError,
+		.useEvent   = true
+	};
+
+	UART_Init(UART1, uartConfig);
+	baudIdx = baud;
+}
+
+static void uartChange(uint8_t baud)
+{
+	if(baud != baudIdx)
+	{
+		UART_Close(UART1);
+		uartInit(baud);
+	}
+}
+
+static void linkBusy(void)
+{
+	// Keep the CPU fast while waiting for bytes from the MCU
+	if(echoSkip || replyCmd || buffIdx || linkTestRunning)
+		freq_begin(FREQ_PHASE_LINK);
+	else
+		freq_end(FREQ_PHASE_LINK);
+}
+
+static void send(uint8_t data, uint8_t reply)
+{
+	freq_begin(FREQ_PHASE_LINK);
+	echoSkip++;
+	if(reply)
+	{
+		replyCmd = data;
+		replyWait = REPLY_TIMEOUT;
+	}
+	UART_Write(UART1, &data, 1);
+}
+
+static void linkReset(void)
+{
+	// Go back to 9600, the MCU will get a framing error from the 0x00 byte and do the same
+	uartChange(MAIL_COMM_BAUD_9600);
+	replyCmd = 0;
+	send(MAIL_COMM_RESERVED, 0);
+}
 
 void mailcomm_init()
 {
-    // UART1 for MCU comms
-    UART_Config_t uartConfig = {
-        .baudRate = UART_BAUD_RATE_9600,
-        .dataBits = UART_DATA_BITS_8,
-        .stopBits = UART_STOP_BITS_1,
-        .parity   = UART_PARITY_NONE,
-        .rxCallback = NULL,
-		.errorCallback = NULL,
-        .useEvent   = true
-    };
-    UART_Init(UART1, uartConfig);
+	baudIdx = MAIL_COMM_BAUD_9600;
+	uartInit(MAIL_COMM_BAUD_9600);
 }
 
 void mailcomm_request()
 {
-	buffIdx = 0;
-	uint8_t data = MAIL_COMM_REQUEST;
-	UART_Write(UART1, &data, 1);
+	// The reply is a status frame, same as a push from the MCU
+	send(MAIL_COMM_REQUEST, 0);
 	PRINTD("req action");
 }
 
 void mailcomm_keepalive()
 {
-	buffIdx = 0;
-	uint8_t data = MAIL_COMM_KEEPALIVE;
-	UART_Write(UART1, &data, 1);
+	send(MAIL_COMM_KEEPALIVE, 0);
 	PRINTD("keepalive");
 }
 
 void mailcomm_poweroff(uint8_t status)
 {
-	buffIdx = 0;
-	uint8_t data = (status<<3) | MAIL_COMM_POWEROFF;
-	UART_Write(UART1, &data, 1);
+	send((status<<3) | MAIL_COMM_POWEROFF, 0);
 	PRINTD("req poweroff %u", status);
 }
 
+void mailcomm_negotiate()
+{
+	// Switch to a faster baud rate, nothing else should be sent until the MCU has replied (takes a few ms)
+	if(!baudFailed && baudIdx == MAIL_COMM_BAUD_9600 && MAILCOMM_BAUD != MAIL_COMM_BAUD_9600)
+	{
+		send((MAILCOMM_BAUD<<3) | MAIL_COMM_BAUD, 1);
+		PRINTD("req baud %u", MAILCOMM_BAUD);
+	}
+}
+
+void mailcomm_heartbeat(uint8_t hours)
+{
+	// The MCU forgets this if it's reset so send it on every wake
+	send(((hours & 0x1F)<<3) | MAIL_COMM_HEARTBEAT, 0);
+	PRINTD("heartbeat %u", hours);
+}
+
+void mailcomm_linkTest()
+{
+	// Send LINKTEST_COUNT echo bytes at each baud rate and count how many come back correctly
+	memset(linkTestResults, 0, sizeof(linkTestResults));
+	linkTestRunning = 1;
+	linkTestBaud = MAIL_COMM_BAUD_9600;
+	linkTestSent = 0;
+	linkTestWait = 0;
+	linkTestPause = 0;
+}
+
 uint8_t* mailcomm_getBuff()
 {
-	return buff;
+	return frame;
+}
+
+static void linkTestNext(void)
+{
+	if(linkTestSent >= LINKTEST_COUNT)
+	{
+		linkTestResult_t* res = &linkTestResults[linkTestBaud];
+		PRINTD(
+			"LINK TEST %u: ok %u, bad %u, lost %u, errors %u (%u ppm)",
+			baudRates[linkTestBaud],
+			res->ok,
+			res->bad,
+			res->lost,
+			res->errors,
+			((res->bad + res->lost) * 1000000UL) / LINKTEST_COUNT
+		);
+
+		linkTestBaud++;
+		linkTestSent = 0;
+		if(linkTestBaud >= MAIL_COMM_BAUD_COUNT)
+		{
+			linkTestRunning = 0;
+			linkReset();
+			mail_sendEvent(MAILBOX_EVT_MAILCOMM_LINKTEST, 0, 0, NULL, NULL);
+			return;
+		}
+	}
+
+	if(linkTestSent == 0 && baudIdx != linkTestBaud)
+	{
+		// Switch MCU to the next rate first, always done from 9600 so a failed rate doesn't break the rest of the test
+		if(baudIdx != MAIL_COMM_BAUD_9600)
+		{
+			// Give the reset byte a tick to go out before sending the baud change
+			linkReset();
+			linkTestWait = 0;
+			linkTestPause = 1;
+			return;
+		}
+		linkTestExpect = (linkTestBaud<<3) | MAIL_COMM_BAUD;
+		send(linkTestExpect, 1);
+	}
+	else
+	{
+		linkTestExpect = ((linkTestSent & 0x1F)<<3) | MAIL_COMM_ECHO;
+		send(linkTestExpect, 1);
+		linkTestSent++;
+	}
+
+	linkTestWait = LINKTEST_TIMEOUT;
+}
+
+static void processReply(uint8_t sent, uint8_t reply)
+{
+	uint8_t cmd = sent & 0x07;
+
+	if(linkTestRunning)
+	{
+		linkTestWait = 0;
+		if(cmd == MAIL_COMM_BAUD)
+		{
+			if(reply == linkTestExpect)
+				uartChange(linkTestBaud);
+			else // MCU doesn't support this rate?
+				linkTestSent = LINKTEST_COUNT;
+		}
+		else if(cmd == MAIL_COMM_ECHO)
+		{
+			if(reply == linkTestExpect)
+				linkTestResults[linkTestBaud].ok++;
+			else
+				linkTestResults[linkTestBaud].bad++;
+		}
+		linkTestNext();
+		return;
+	}
+
+	switch(cmd)
+	{
+		case MAIL_COMM_BAUD:
+			if(reply == sent) // MCU has switched
+			{
+				uartChange(sent>>3);
+				PRINTD("Baud %u", baudRates[baudIdx]);
+			}
+			else // Older MCU firmware will reply with '?'
+			{
+				PRINTD("Baud change failed");
+				baudFailed = 1;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+static void processFrame(void)
+{
+	uint8_t sum = 0;
+	for(uint8_t i=0;i<MAIL_COMM_FRAME_CHECKSUM;i++)
+		sum += buff[i];
+
+	if(sum != buff[MAIL_COMM_FRAME_CHECKSUM])
+	{
+		// MCU will push again if we don't ack
+		PRINTD("Bad frame checksum %02x %02x", sum, buff[MAIL_COMM_FRAME_CHECKSUM]);
+		return;
+	}
+
+	memcpy(frame, buff, sizeof(frame));
+
+	// Ack so the MCU stops pushing
+	mailcomm_keepalive();
+
+	PRINTD("Got DO command");
+	mail_sendEvent(MAILBOX_EVT_MAILCOMM_RESPONSE, MAIL_COMM_DO, 0, NULL, NULL);
+}
+
+static void parseByte(uint8_t data)
+{
+	if(echoSkip) // Our own byte coming back from the loopback
+	{
+		echoSkip--;
+		return;
+	}
+
+	if(buffIdx) // Part way through a frame
+	{
+		buff[buffIdx] = data;
+		buffIdx++;
+		if(buffIdx >= MAIL_COMM_FRAME_LEN)
+		{
+			buffIdx = 0;
+			processFrame();
+		}
+	}
+	else if(replyCmd)
+	{
+		uint8_t sent = replyCmd;
+		replyCmd = 0;
+		processReply(sent, data);
+	}
+	else if((data & 0x07) == MAIL_COMM_DO) // Start of a status frame, might be unsolicited
+	{
+		if((data>>3) == MAIL_COMM_FRAME_VERSION)
+		{
+			buff[0] = data;
+			buffIdx = 1;
+		}
+		else if(!versionWarned) // Different layout, parsing it would just give garbage
+		{
+			versionWarned = 1;
+			PRINTD("MCU frame version %u, expected %u. Flash the MCU and A9G from the same release", data>>3, MAIL_COMM_FRAME_VERSION);
+		}
+	}
 }
 
 static void uartStuff(uint32_t len, uint8_t* data)
 {
-#if DEBUG
+#if DEBUG && DEBUG_UART
 	char dbg[128];
 	uint8_t idx = 0;
 	for(uint32_t i=0;i<len;i++)
@@ -70,25 +337,51 @@ static void uartStuff(uint32_t len, uint8_t* data)
 	PRINTD("UART1: %s", dbg);
 #endif
 
+	idleTicks = 0;
 	for(uint32_t i=0;i<len;i++)
+		parseByte(data[i]);
+
+	linkBusy();
+}
+
+void mailcomm_update()
+{
+	// Drop anything half received, a collision on the wire or a missed loopback byte
+	if((buffIdx || echoSkip) && ++idleTicks > FRAME_TIMEOUT)
+	{
+		buffIdx = 0;
+		echoSkip = 0;
+	}
+
+	if(linkTestRunning)
 	{
-		if(buffIdx < BUFF_LEN)
+		if(linkTestPause)
+			linkTestPause = 0;
+		else if(linkTestWait == 0)
+			linkTestNext();
+		else if(--linkTestWait == 0)
 		{
-			//PRINTD("UART1: %02x", data[i]);
-			buff[buffIdx] = data[i];
-			buffIdx++;
+			// No reply
+			if((linkTestExpect & 0x07) == MAIL_COMM_ECHO)
+				linkTestResults[linkTestBaud].lost++;
+			else
+				linkTestSent = LINKTEST_COUNT;
+			replyCmd = 0;
+			linkTestNext();
 		}
 	}
-
-	if(buffIdx >= BUFF_LEN)
+	else if(replyCmd && --replyWait == 0)
 	{
-		buffIdx = 0;
-		if(buff[0] == MAIL_COMM_REQUEST && buff[1] == MAIL_COMM_DO)
+		// No reply, only baud changes are waited on outside of the link test
+		if((replyCmd & 0x07) == MAIL_COMM_BAUD)
 		{
-			PRINTD("Got DO command");
-			mail_sendEvent(MAILBOX_EVT_MAILCOMM_RESPONSE, MAIL_COMM_DO, 0, NULL, NULL);
+			PRINTD("Baud change timed out");
+			baudFailed = 1;
 		}
+		replyCmd = 0;
 	}
+
+	linkBusy();
 }
 
 void mailcomm_event(API_Event_t* pEvent)
@@ -101,7 +394,7 @@ void mailcomm_event(API_Event_t* pEvent)
 				//PRINTD("UART1: %s", (char*)pEvent->pParam1);
 				//PRINTD("UART1: %02x %02x %02x %02x %02x", pEvent->pParam1[0], pEvent->pParam1[1], pEvent->pParam1[2], pEvent->pParam1[3], pEvent->pParam1[4]);
 				uartStuff(pEvent->param2, (uint8_t*)pEvent->pParam1);
-				
+
 				/*if(((char*)pEvent->pParam1)[0] == 'a')
 					gsm_connect();
 				else if(((char*)pEvent->pParam1)[0] == 's')
@@ -118,6 +411,17 @@ void mailcomm_event(API_Event_t* pEvent)
 				}*/
 			}
 			break;
+		case MAILBOX_EVT_MAILCOMM_ERROR:
+			PRINTD("UART1 error %u", pEvent->param1);
+			if(linkTestRunning)
+				linkTestResults[linkTestBaud].errors++;
+			else if(baudIdx != MAIL_COMM_BAUD_9600)
+			{
+				// Framing errors and things, fall back to 9600 for the rest of the session
+				baudFailed = 1;
+				linkReset();
+			}
+			break;
 		default:
 			break;
 	}
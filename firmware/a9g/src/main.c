@@ -21,7 +21,8 @@ static HANDLE mailboxTaskHandle = NULL;
 extern char* fwBuild;
 static Power_On_Cause_t pwrOnCause;
 
-void EventDispatch(API_Event_t* pEvent)
+// Returns true if the event was handed over to the mailbox task, it will be freed there
+bool EventDispatch(API_Event_t* pEvent)
 {
     switch(pEvent->id)
     {
@@ -48,6 +49,7 @@ void EventDispatch(API_Event_t* pEvent)
 			break;
 		case API_EVENT_ID_MALLOC_FAILED:
 			PRINTD("MALLOC FAILED");
+			telemetry_mallocFailed();
 			break;
 		case API_EVENT_ID_POWER_INFO:
 			break;
@@ -56,10 +58,11 @@ void EventDispatch(API_Event_t* pEvent)
 		case API_EVENT_ID_USSD_SEND_FAIL:
 			break;
         default:
-			mailbox_eventDispatch(pEvent);
 //			PRINTD("EVT2 %d %d %d", pEvent->id, pEvent->param1, pEvent->param2);
-            break;
+			return mailbox_forwardEvent(pEvent);
     }
+
+	return false;
 }
 
 static void unusedGPIO(GPIO_PIN pin)
@@ -112,7 +115,11 @@ static GPIO_PIN unused[] = {
 
 static void init(void)
 {
-	PM_SetSysMinFreq(PM_SYS_FREQ_13M);
+	logring_init();
+	freq_init();
+	settings_init();
+	delta_init();
+	track_init();
 
 	for(uint8_t i=0;i<sizeof(unused)/sizeof(GPIO_PIN);i++)
 		unusedGPIO(unused[i]);
@@ -128,11 +135,8 @@ static void init(void)
 	};
 	GPIO_Init(gpioGPSAntennaPower);
 
-	// BME280
+	// BME280 (I2C is set up by bme280_init())
 	PM_PowerEnable(POWER_TYPE_CAM, true);
-    I2C_Config_t i2cConfig;
-    i2cConfig.freq = I2C_FREQ_100K;
-    I2C_Init(I2C2, i2cConfig);
 
 	TIME_SetIsAutoUpdateRtcTime(true);
 	gsm_init();
@@ -144,11 +148,12 @@ static void init(void)
 
 void MainTask(void *pData)
 {
+	telemetry_taskStart(TELEMETRY_TASK_MAIN);
 	init();
 
 	mailboxTaskHandle = OS_CreateTask(
 		mailbox_task,
-		&mailboxTaskHandle,
+		NULL,
 		NULL,
 		MAILBOX_TASK_STACK_SIZE,
 		MAILBOX_TASK_PRIORITY,
@@ -162,10 +167,12 @@ void MainTask(void *pData)
 	{
 		if(OS_WaitEvent(mainTaskHandle, (void**)&event, OS_TIME_OUT_WAIT_FOREVER))
 		{
-			EventDispatch(event);
-			OS_Free(event->pParam1);
-			OS_Free(event->pParam2);
-			OS_Free(event);
+			if(!EventDispatch(event))
+			{
+				OS_Free(event->pParam1);
+				OS_Free(event->pParam2);
+				OS_Free(event);
+			}
 		}
 	}
 }
@@ -0,0 +1,78 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#include "common.h"
+
+settings_t settings;
+
+static void setDefaults(void)
+{
+	settings.version = SETTINGS_VERSION;
+	settings.encoding = SETTINGS_ENCODING_FULL;
+	settings.heartbeat = 0;
+	settings.balForce = 0;
+	settings.trackInterval = 60;
+	memset(settings.plmn, 0, sizeof(settings.plmn));
+}
+
+uint8_t settings_readFile(const char* path, void* data, uint32_t len)
+{
+	int32_t fd = API_FS_Open(path, FS_O_RDONLY, 0);
+	if(fd < 0)
+		return 0;
+
+	int32_t res = API_FS_Read(fd, (uint8_t*)data, len);
+	API_FS_Close(fd);
+
+	if(res != (int32_t)len)
+	{
+		DBG_MAIL("Read %s failed (%d)", path, res);
+		return 0;
+	}
+	return 1;
+}
+
+uint8_t settings_writeFile(const char* path, void* data, uint32_t len)
+{
+	int32_t fd = API_FS_Open(path, FS_O_WRONLY | FS_O_CREAT | FS_O_TRUNC, 0);
+	if(fd < 0)
+	{
+		DBG_MAIL("Open %s failed (%d)", path, fd);
+		return 0;
+	}
+
+	int32_t res = API_FS_Write(fd, (uint8_t*)data, len);
+	API_FS_Flush(fd);
+	API_FS_Close(fd);
+
+	if(res != (int32_t)len)
+	{
+		DBG_MAIL("Write %s failed (%d)", path, res);
+		return 0;
+	}
+	return 1;
+}
+
+void settings_init()
+{
+	setDefaults();
+
+	// Anything from a different firmware version might not line up, just use the defaults
+	settings_t tmp;
+	if(settings_readFile(SETTINGS_FILE, &tmp, sizeof(tmp)) && tmp.version == SETTINGS_VERSION)
+		memcpy(&settings, &tmp, sizeof(settings));
+	else
+		DBG_MAIL("No settings, using defaults");
+
+	DBG_MAIL("Settings: enc %u, hb %u, bal %u, ti %u", settings.encoding, settings.heartbeat, settings.balForce, settings.trackInterval);
+}
+
+void settings_save()
+{
+	settings_writeFile(SETTINGS_FILE, &settings, sizeof(settings));
+}
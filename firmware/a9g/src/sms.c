@@ -8,6 +8,8 @@
 
 #include "common.h"
 
+#define SMS_STORAGE_RESERVE	3 // Clear the SIM before doing anything else if there are fewer than this many free slots
+
 // BUG: Unicode SMSs will leak memory when listing stored messages
 // BUG: Unicode SMSs are not listed when listing stored messages
 // BUG: If a message is received from a number that begins with a space then the number will not be stored (number field will be blank when listing messages)
@@ -15,6 +17,7 @@
 
 static SMSList_Callback_t smsList_callback;
 static SMSNewMessage_Callback_t smsNewMessage_callback;
+static uint8_t clearIdx;
 //static uint8_t unicodeBug;
 
 void sms_init()
@@ -36,57 +39,56 @@ void sms_init()
 		DBG_SMS("Set message storage fail");
 }
 
-uint8_t sms_clearAll()
+uint8_t sms_storageNearlyFull()
 {
+	// Balance replies get stored on the SIM, make sure there's room for them
+
+	SMS_Storage_Info_t storageInfo;
+
+	if(!SMS_GetStorageInfo(&storageInfo, SMS_STORAGE_SIM_CARD))
+	{
+		DBG_SMS("Error getting storage info");
+		return 1;
+	}
+
+	DBG_SMS("SIM card storage: %u/%u", storageInfo.used, storageInfo.total);
+	return (storageInfo.used + SMS_STORAGE_RESERVE >= storageInfo.total);
+}
+
+uint8_t sms_clearStep(uint8_t count)
+{
+	// Deletes up to count slots each call so it doesn't block for too long
 	// 0 = there are still some SMSs to delete
 	// 1 = all SMSs deleted
 
 	SMS_Storage_Info_t storageInfo;
 	
-	if(SMS_GetStorageInfo(&storageInfo, SMS_STORAGE_SIM_CARD))
+	if(!SMS_GetStorageInfo(&storageInfo, SMS_STORAGE_SIM_CARD))
 	{
-		DBG_SMS("SIM card storage: %u/%u", storageInfo.used, storageInfo.total);
+		DBG_SMS("Error getting storage info");
+		return 0;
+	}
 
-		// Delete starting from first SMS to however many SMSs are stored (only properly works if there are no holes in stored message IDs)
-		uint8_t i = 1;
-		for(;i<storageInfo.used;i++)
-		{
-			// SMS_DeleteMessage() always returns true even when deleting non-existing SMSs?
-			if(SMS_DeleteMessage(i, SMS_STATUS_ALL, SMS_STORAGE_SIM_CARD))
-				DBG_SMS("Delete %u success", i);
-			else
-				DBG_SMS("Delete %u fail", i);
-		}
+	if(storageInfo.used == 0)
+	{
+		clearIdx = 0;
+		return 1;
+	}
 
-		// Check to make sure all deleted
-		// If still some remaining, then continue until max ID stored in SIM card
-		for(;
-			SMS_GetStorageInfo(&storageInfo, SMS_STORAGE_SIM_CARD) &&
-			i<storageInfo.total+1 &&
-			storageInfo.used > 0
-		;i++)
-		{
-			// SMS_DeleteMessage() always returns true even when deleting non-existing SMSs?
-			if(SMS_DeleteMessage(i, SMS_STATUS_ALL, SMS_STORAGE_SIM_CARD))
-				DBG_SMS("Delete %u success", i);
-			else
-				DBG_SMS("Delete %u fail", i);
-		}
+	// Go through every slot up to the max ID stored in SIM card since there might be holes in stored message IDs
+	for(;count>0;count--)
+	{
+		clearIdx++;
+		if(clearIdx > storageInfo.total)
+			clearIdx = 1;
 
-		// Check to see if all SMSs have been deleted
-		if(SMS_GetStorageInfo(&storageInfo, SMS_STORAGE_SIM_CARD))
-		{
-			if(storageInfo.used > 0)
-			{
-				DBG_SMS("Still %u SMSs left!", storageInfo.used);
-				return 0;
-			}
-			
-			return 1;
-		}
+		// SMS_DeleteMessage() always returns true even when deleting non-existing SMSs?
+		if(SMS_DeleteMessage(clearIdx, SMS_STATUS_ALL, SMS_STORAGE_SIM_CARD))
+			DBG_SMS("Delete %u success", clearIdx);
+		else
+			DBG_SMS("Delete %u fail", clearIdx);
 	}
 
-	DBG_SMS("Error getting storage info");
 	return 0;
 }
 
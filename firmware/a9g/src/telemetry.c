@@ -0,0 +1,91 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#include "common.h"
+
+// Stack and heap usage, so we know how much room there is before shrinking buffers or moving stuff between tasks
+
+#define STACK_PAINT		0xA5A5A5A5
+#define STACK_MARGIN	64 // Don't paint right up to the current stack pointer (bytes)
+
+typedef struct {
+	uint32_t* top; // Lowest address, stack grows down towards this
+	uint32_t size; // Bytes
+} taskStack_t;
+
+static taskStack_t stacks[TELEMETRY_TASK_COUNT];
+static uint32_t heapPeak;
+static uint32_t heapTotal;
+static uint32_t mallocFails;
+
+void telemetry_taskStart(uint8_t task)
+{
+	// Must be called from the task itself, as early as possible
+	// The handle is looked up here since whoever created the task might not have stored it yet
+	OS_Task_Info_t info;
+	if(!OS_GetTaskInfo(OS_GetCurrentTask(), &info))
+		return;
+
+	volatile uint32_t here = 0;
+	stacks[task].top = (uint32_t*)info.stackTop;
+	stacks[task].size = info.stackSize * 4;
+
+	// Fill everything below our own stack frame, anything that gets overwritten later has been used at some point
+	uint32_t* end = (uint32_t*)(((uint32_t)&here - STACK_MARGIN) & ~3);
+	for(uint32_t* p = stacks[task].top;p < end;p++)
+		*p = STACK_PAINT;
+}
+
+uint32_t telemetry_stackPeak(uint8_t task)
+{
+	if(stacks[task].top == NULL)
+		return 0;
+
+	uint32_t unused = 0;
+	uint32_t words = stacks[task].size / 4;
+	while(unused < words && stacks[task].top[unused] == STACK_PAINT)
+		unused++;
+	return stacks[task].size - (unused * 4);
+}
+
+uint32_t telemetry_stackSize(uint8_t task)
+{
+	return stacks[task].size;
+}
+
+void telemetry_heapSample()
+{
+	OS_Heap_Status_t status;
+	OS_GetHeapUsageStatus(&status);
+	heapTotal = status.totalSize;
+	if(status.usedSize > heapPeak)
+		heapPeak = status.usedSize;
+}
+
+uint32_t telemetry_heapPeak()
+{
+	return heapPeak;
+}
+
+uint32_t telemetry_heapTotal()
+{
+	return heapTotal;
+}
+
+void telemetry_mallocFailed()
+{
+	// Called from both tasks
+	uint32_t cs = OS_EnterCriticalSection();
+	mallocFails++;
+	OS_ExitCriticalSection(cs);
+}
+
+uint32_t telemetry_mallocFails()
+{
+	return mallocFails;
+}
@@ -0,0 +1,349 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#include "common.h"
+
+// GPS track points waiting to be uploaded
+// Points on a straight line don't add anything, so they're simplified as they come in (opening window):
+// Keep extending a line from the last kept point (anchor) to the newest point, as soon as one of the points in between
+// is more than TRACK_TOLERANCE metres away from the line then the point before the newest one is kept and becomes the new anchor.
+//
+// Kept points wait in RAM while GPRS is up. While it's down (or RAM fills up) they're moved to a queue in flash so they
+// survive until the connection comes back. The queue is a ring of TRACK_QUEUE_SEGMENTS files that are only ever appended to
+// and then deleted once everything in them has been uploaded, so the writes get spread around.
+// Everything in flash is always older than everything in RAM, so uploads take from flash first.
+// How far through the oldest file we are isn't saved, after a reboot some points might be sent again.
+
+#define METRES_PER_UNIT	1.11195f // Metres per 0.00001 degree of latitude
+#define OWNER_NONE		0xFF
+
+static track_point_t points[TRACK_POINTS_MAX]; // Kept points, oldest first from pointsHead
+static uint8_t pointsHead;
+static uint8_t pointsCount;
+static track_point_t batch[TRACK_UPLOAD_MAX];
+static uint8_t segCount[TRACK_QUEUE_SEGMENTS]; // Points in each file
+static uint32_t segFirst[TRACK_QUEUE_SEGMENTS]; // ID of the first point in each file, IDs in a file are consecutive
+static uint8_t readSeg;
+static uint8_t readIdx; // Points in readSeg already uploaded
+static uint8_t writeSeg;
+static uint16_t queued;
+static uint32_t drained;
+static uint32_t lost;
+static track_point_t anchor;
+static uint8_t haveAnchor;
+static track_point_t window[TRACK_WINDOW]; // Points since the anchor that haven't been kept (yet)
+static uint8_t windowLen;
+static uint32_t nextId;
+static uint32_t inCount;
+static uint32_t outCount;
+static uint8_t batchOwner = OWNER_NONE; // Whoever has the batch out, only one upload at a time can have points or they'd both send the same ones
+
+static char* segName(uint8_t seg, char* buff)
+{
+	sprintf(buff, TRACK_QUEUE_FILE, seg);
+	return buff;
+}
+
+static void segDelete(uint8_t seg)
+{
+	char name[16];
+	API_FS_Delete(segName(seg, name));
+	segCount[seg] = 0;
+}
+
+static void queueAppend(const track_point_t* point)
+{
+	char name[16];
+
+	if(segCount[writeSeg] >= TRACK_QUEUE_SEG_POINTS)
+	{
+		writeSeg = (writeSeg + 1) % TRACK_QUEUE_SEGMENTS;
+		if(segCount[writeSeg]) // Caught up with the oldest file, lose it
+		{
+			uint8_t count = segCount[writeSeg] - readIdx; // readSeg must be writeSeg here
+			lost += count;
+			queued -= count;
+			segDelete(writeSeg);
+			readSeg = (readSeg + 1) % TRACK_QUEUE_SEGMENTS;
+			readIdx = 0;
+		}
+	}
+
+	int32_t fd = API_FS_Open(segName(writeSeg, name), FS_O_WRONLY | FS_O_CREAT | FS_O_APPEND, 0);
+	if(fd < 0)
+	{
+		DBG_MAIL("Open %s failed (%d)", name, fd);
+		lost++;
+		return;
+	}
+	int32_t res = API_FS_Write(fd, (uint8_t*)point, sizeof(track_point_t));
+	API_FS_Close(fd);
+	if(res != sizeof(track_point_t))
+	{
+		DBG_MAIL("Write %s failed (%d)", name, res);
+		lost++;
+		return;
+	}
+
+	if(segCount[writeSeg] == 0)
+		segFirst[writeSeg] = point->id;
+	segCount[writeSeg]++;
+	queued++;
+}
+
+static void spill(void)
+{
+	// Move everything in RAM to the flash queue
+	for(;pointsCount;pointsCount--)
+	{
+		queueAppend(&points[pointsHead]);
+		pointsHead = (pointsHead + 1) % TRACK_POINTS_MAX;
+	}
+}
+
+static void keep(const track_point_t* point)
+{
+	// Points aren't written one at a time while disconnected, saves wearing out the flash
+	if(pointsCount >= TRACK_POINTS_MAX || (!gprs_isActive() && pointsCount >= TRACK_SPILL_POINTS))
+		spill();
+
+	track_point_t* p = &points[(pointsHead + pointsCount) % TRACK_POINTS_MAX];
+	*p = *point;
+	p->id = ++nextId;
+	pointsCount++;
+	outCount++;
+}
+
+void track_init()
+{
+	// Find out what was left in the flash queue from before
+	char name[16];
+	uint32_t newest = 0;
+	uint8_t found = 0;
+	for(uint8_t i=0;i<TRACK_QUEUE_SEGMENTS;i++)
+	{
+		segCount[i] = 0;
+		int32_t fd = API_FS_Open(segName(i, name), FS_O_RDONLY, 0);
+		if(fd < 0)
+			continue;
+
+		track_point_t point;
+		int32_t size = API_FS_GetFileSize(fd);
+		if(size >= (int32_t)sizeof(point) && API_FS_Read(fd, (uint8_t*)&point, sizeof(point)) == sizeof(point))
+		{
+			segCount[i] = size / sizeof(point);
+			segFirst[i] = point.id;
+		}
+		API_FS_Close(fd);
+
+		if(segCount[i] == 0)
+		{
+			segDelete(i);
+			continue;
+		}
+
+		if(!found || (int32_t)(point.id - segFirst[readSeg]) < 0)
+			readSeg = i;
+		if(!found || (int32_t)(point.id - segFirst[writeSeg]) > 0)
+			writeSeg = i;
+		found = 1;
+		queued += segCount[i];
+		if((int32_t)(point.id + segCount[i] - 1 - newest) > 0)
+			newest = point.id + segCount[i] - 1;
+	}
+
+	nextId = newest;
+	if(queued)
+		DBG_MAIL("Track queue: %u points", queued);
+}
+
+#if TRACK_SIMPLIFY
+static float offset(const track_point_t* a, const track_point_t* b, const track_point_t* p)
+{
+	// Distance of p from the line a - b, flat earth is fine over these distances
+	float k = cosf(a->lat * (float)(M_PI / 180 / 100000));
+	float bx = (b->lon - a->lon) * k * METRES_PER_UNIT;
+	float by = (b->lat - a->lat) * METRES_PER_UNIT;
+	float px = (p->lon - a->lon) * k * METRES_PER_UNIT;
+	float py = (p->lat - a->lat) * METRES_PER_UNIT;
+
+	float len = (bx * bx) + (by * by);
+	float t = (len > 0) ? ((px * bx) + (py * by)) / len : 0;
+	if(t < 0)
+		t = 0;
+	else if(t > 1)
+		t = 1;
+
+	float dx = px - (t * bx);
+	float dy = py - (t * by);
+	return sqrtf((dx * dx) + (dy * dy));
+}
+#endif
+
+void track_begin()
+{
+	haveAnchor = 0;
+	windowLen = 0;
+}
+
+void track_add(float lat, float lon)
+{
+	track_point_t point;
+	point.lat = lroundf(lat * 100000);
+	point.lon = lroundf(lon * 100000);
+	point.time = time(NULL);
+	if(point.time < TIME_VALID) // The age would be wrong once the network sets the clock, or after a reboot
+		point.time = 0;
+	inCount++;
+
+	if(!haveAnchor)
+	{
+		anchor = point;
+		haveAnchor = 1;
+		keep(&anchor);
+		return;
+	}
+
+#if TRACK_SIMPLIFY
+	uint8_t i;
+	for(i=0;i<windowLen;i++)
+	{
+		if(offset(&anchor, &point, &window[i]) > TRACK_TOLERANCE)
+			break;
+	}
+
+	if(i == windowLen && windowLen < TRACK_WINDOW)
+	{
+		window[windowLen++] = point;
+		return;
+	}
+
+	// Line can't be extended to this point, the one before it is the furthest we can go
+	anchor = window[windowLen - 1];
+	keep(&anchor);
+	window[0] = point;
+	windowLen = 1;
+#else
+	keep(&point);
+#endif
+}
+
+void track_flush()
+{
+	// Keep the newest point so it can go in the next upload
+	if(windowLen)
+	{
+		anchor = window[windowLen - 1];
+		keep(&anchor);
+		windowLen = 0;
+	}
+}
+
+void track_end()
+{
+	// Tracking has been turned off, anything not uploaded yet waits in flash for the next time
+	track_flush();
+	spill();
+}
+
+const track_point_t* track_batch(uint8_t owner, uint8_t* count)
+{
+	// Oldest points that haven't been acknowledged yet, from the flash queue if there's anything in it
+	// They're reserved for owner until track_release(), nobody else gets any until then
+	if(batchOwner != OWNER_NONE && batchOwner != owner)
+	{
+		*count = 0;
+		return batch;
+	}
+
+	uint8_t n = 0;
+	if(queued)
+	{
+		char name[16];
+		n = segCount[readSeg] - readIdx;
+		if(n > TRACK_UPLOAD_MAX)
+			n = TRACK_UPLOAD_MAX;
+
+		int32_t fd = API_FS_Open(segName(readSeg, name), FS_O_RDONLY, 0);
+		if(fd < 0 || API_FS_Seek(fd, readIdx * sizeof(track_point_t), FS_SEEK_SET) < 0 || API_FS_Read(fd, (uint8_t*)batch, n * sizeof(track_point_t)) != (int32_t)(n * sizeof(track_point_t)))
+		{
+			DBG_MAIL("Read %s failed", name);
+			n = 0;
+		}
+		if(fd >= 0)
+			API_FS_Close(fd);
+	}
+	else
+	{
+		n = (pointsCount > TRACK_UPLOAD_MAX) ? TRACK_UPLOAD_MAX : pointsCount;
+		for(uint8_t i=0;i<n;i++)
+			batch[i] = points[(pointsHead + i) % TRACK_POINTS_MAX];
+	}
+
+	if(n)
+		batchOwner = owner;
+
+	*count = n;
+	return batch;
+}
+
+void track_release(uint8_t owner)
+{
+	// Upload finished, anything that wasn't acknowledged goes in the next batch
+	if(batchOwner == owner)
+		batchOwner = OWNER_NONE;
+}
+
+void track_ack(uint32_t id)
+{
+	// Server has everything up to and including this point
+	while(queued && (int32_t)(segFirst[readSeg] + readIdx - id) <= 0)
+	{
+		readIdx++;
+		queued--;
+		drained++;
+		if(readIdx >= segCount[readSeg])
+		{
+			segDelete(readSeg);
+			readIdx = 0;
+			if(readSeg != writeSeg)
+				readSeg = (readSeg + 1) % TRACK_QUEUE_SEGMENTS;
+		}
+	}
+
+	while(pointsCount && (int32_t)(points[pointsHead].id - id) <= 0)
+	{
+		pointsHead = (pointsHead + 1) % TRACK_POINTS_MAX;
+		pointsCount--;
+	}
+}
+
+uint32_t track_in()
+{
+	return inCount;
+}
+
+uint32_t track_out()
+{
+	return outCount;
+}
+
+uint16_t track_queued()
+{
+	return queued;
+}
+
+uint32_t track_drained()
+{
+	return drained;
+}
+
+uint32_t track_lost()
+{
+	return lost;
+}
@@ -0,0 +1,218 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License:
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+// Runs bme280.c against a fake register map loaded with the datasheet example calibration and raw readings
+
+#include "common.h"
+#include <math.h>
+
+#define ADDR	0x76
+
+static uint8_t regs[256];
+static uint8_t regPtr;
+static uint8_t failCount; // Fail this many transfers with I2C_ERROR_RESOURCE_BUSY
+static uint8_t initCount;
+static uint8_t closeCount;
+static uint8_t failures;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+bool I2C_Init(I2C_ID_t id, I2C_Config_t config)
+{
+	(void)id;
+	(void)config;
+	initCount++;
+	return true;
+}
+
+bool I2C_Close(I2C_ID_t id)
+{
+	(void)id;
+	closeCount++;
+	return true;
+}
+
+I2C_Error_t I2C_Transmit(I2C_ID_t id, uint16_t slaveAddr, uint8_t* pData, uint16_t length, uint32_t timeOut)
+{
+	(void)timeOut;
+	if(id != I2C2 || slaveAddr != ADDR || length < 1)
+		return I2C_ERROR_BAD_PARAMETER;
+	if(failCount)
+	{
+		failCount--;
+		return I2C_ERROR_RESOURCE_BUSY;
+	}
+
+	// First byte is the register address, anything after is written from there
+	regPtr = pData[0];
+	for(uint16_t i=1;i<length;i++)
+		regs[regPtr++] = pData[i];
+	return I2C_ERROR_NONE;
+}
+
+I2C_Error_t I2C_Receive(I2C_ID_t id, uint16_t slaveAddr, uint8_t* pData, uint16_t length, uint32_t timeOut)
+{
+	(void)timeOut;
+	if(id != I2C2 || slaveAddr != ADDR)
+		return I2C_ERROR_BAD_PARAMETER;
+	if(failCount)
+	{
+		failCount--;
+		return I2C_ERROR_RESOURCE_BUSY;
+	}
+
+	for(uint16_t i=0;i<length;i++)
+		pData[i] = regs[regPtr++];
+	return I2C_ERROR_NONE;
+}
+
+static void setReg16(uint8_t reg, uint16_t val)
+{
+	regs[reg] = val;
+	regs[reg + 1] = val>>8;
+}
+
+static void setRaw(uint32_t adc_P, uint32_t adc_T, uint16_t adc_H)
+{
+	regs[0xF7] = adc_P>>12;
+	regs[0xF8] = adc_P>>4;
+	regs[0xF9] = adc_P<<4;
+	regs[0xFA] = adc_T>>12;
+	regs[0xFB] = adc_T>>4;
+	regs[0xFC] = adc_T<<4;
+	regs[0xFD] = adc_H>>8;
+	regs[0xFE] = adc_H;
+}
+
+// Temperature and pressure calibration from the BMP280 datasheet example (section 3.12), humidity from a typical part
+static void loadCalib(void)
+{
+	memset(regs, 0, sizeof(regs));
+
+	setReg16(0x88, 27504); // T1
+	setReg16(0x8A, 26435); // T2
+	setReg16(0x8C, (uint16_t)-1000); // T3
+	setReg16(0x8E, 36477); // P1
+	setReg16(0x90, (uint16_t)-10685); // P2
+	setReg16(0x92, 3024); // P3
+	setReg16(0x94, 2855); // P4
+	setReg16(0x96, 140); // P5
+	setReg16(0x98, (uint16_t)-7); // P6
+	setReg16(0x9A, 15500); // P7
+	setReg16(0x9C, (uint16_t)-14600); // P8
+	setReg16(0x9E, 6000); // P9
+	regs[0xA1] = 75; // H1
+	setReg16(0xE1, 362); // H2
+	regs[0xE3] = 0; // H3
+	regs[0xE4] = 0x13; // H4 = 313 (0x139), H5 = 50 (0x032)
+	regs[0xE5] = 0x29;
+	regs[0xE6] = 0x03;
+	regs[0xE7] = 30; // H6
+}
+
+// Floating point humidity formula from the BME280 datasheet
+static double humidityRef(double t_fine, double adc_H)
+{
+	double H1 = 75, H2 = 362, H3 = 0, H4 = 313, H5 = 50, H6 = 30;
+	double h = t_fine - 76800.0;
+	h = (adc_H - (H4 * 64.0 + H5 / 16384.0 * h)) * (H2 / 65536.0 * (1.0 + H6 / 67108864.0 * h * (1.0 + H3 / 67108864.0 * h)));
+	h = h * (1.0 - H1 * h / 524288.0);
+	if(h > 100.0)
+		h = 100.0;
+	else if(h < 0.0)
+		h = 0.0;
+	return h;
+}
+
+static void testCompensation(void)
+{
+	loadCalib();
+	setRaw(415148, 519888, 30000);
+	bme280_init();
+
+	// Profile gets written and the part is left asleep
+	CHECK(regs[0xF2] == 1);
+	CHECK(regs[0xF4] == ((1<<5) | (1<<2)));
+	CHECK(regs[0xF5] == 0);
+
+	bme280_data_t data;
+	CHECK(bme280_read(&data) == 1);
+
+	// Datasheet: T = 25.08 DegC (t_fine 128422), P = 100653.27 Pa
+	// The datasheet's pressure comes from the floating point t_fine, the integer one lands 0.02 Pa lower
+	CHECK(data.temperature == 2508);
+	CHECK(data.pressure == 25767233);
+	CHECK(fabs(data.pressure / 256.0 - 100653.27) < 0.05);
+
+	double hum = data.humidity / 1024.0;
+	double ref = humidityRef(128422, 30000);
+	CHECK(fabs(hum - ref) < 0.05);
+	CHECK(hum > 0 && hum < 100);
+}
+
+static void testSkipped(void)
+{
+	loadCalib();
+	bme280_init();
+
+	bme280_data_t data;
+
+	// Skipped pressure and humidity read as 0x80000 and 0x8000, temperature still valid
+	setRaw(0x80000, 519888, 0x8000);
+	CHECK(bme280_read(&data) == 1);
+	CHECK(data.temperature == 2508);
+	CHECK(data.pressure == 0);
+	CHECK(data.humidity == 0);
+
+	// Nothing can be compensated without temperature
+	setRaw(415148, 0x80000, 30000);
+	CHECK(bme280_read(&data) == 0);
+	CHECK(data.temperature == 0 && data.pressure == 0 && data.humidity == 0);
+}
+
+static void testRecover(void)
+{
+	loadCalib();
+	setRaw(415148, 519888, 30000);
+	bme280_init();
+
+	bme280_data_t data;
+
+	// One busy transfer gets the peripheral re-initialised and the read retried
+	initCount = closeCount = 0;
+	failCount = 1;
+	CHECK(bme280_read(&data) == 1);
+	CHECK(closeCount == 1 && initCount == 1);
+	CHECK(data.temperature == 2508);
+
+	// Gives up after I2C_RETRIES
+	failCount = 100;
+	CHECK(bme280_read(&data) == 0);
+	CHECK(bme280_status() == 0xFF);
+	failCount = 0;
+}
+
+int main(void)
+{
+	testCompensation();
+	testSkipped();
+	testRecover();
+
+	if(failures)
+	{
+		printf("bme280: %u failed\n", failures);
+		return 1;
+	}
+	printf("bme280: ok\n");
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License:
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+// Feeds server responses through cmd.c in various sized chunks
+
+#include "common.h"
+
+static uint8_t failures;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+// Feed the whole thing in chunks of chunkLen bytes, the way it might come off the socket
+static void feed(cmd_t* cmd, const char* data, uint32_t chunkLen)
+{
+	cmd_begin(cmd);
+	uint32_t len = strlen(data);
+	for(uint32_t i=0;i<len;i+=chunkLen)
+		cmd_feed(cmd, data + i, (len - i < chunkLen) ? len - i : chunkLen);
+}
+
+static uint8_t has(cmd_t* cmd, uint8_t key, int32_t expect)
+{
+	int32_t value;
+	return (cmd_get(cmd, key, &value) && value == expect);
+}
+
+static uint8_t missing(cmd_t* cmd, uint8_t key)
+{
+	int32_t value;
+	return !cmd_get(cmd, key, &value);
+}
+
+static void testBasic(void)
+{
+	static const char resp[] =
+		"HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n"
+		"{\"result\":\"ok\",\"cmd\":{\"ti\":30,\"bal\":1,\"enc\":1,\"hb\":24,\"rs\":1}}";
+
+	// Every chunk size from 1 byte to all of it in one go
+	for(uint32_t chunk=1;chunk<=sizeof(resp);chunk++)
+	{
+		cmd_t cmd;
+		feed(&cmd, resp, chunk);
+		CHECK(cmd_done(&cmd));
+		CHECK(cmd_resultOk(&cmd));
+		CHECK(has(&cmd, CMD_TRACKINTERVAL, 30));
+		CHECK(has(&cmd, CMD_BALANCE, 1));
+		CHECK(has(&cmd, CMD_ENCODING, 1));
+		CHECK(has(&cmd, CMD_HEARTBEAT, 24));
+		CHECK(has(&cmd, CMD_RESYNC, 1));
+	}
+
+	// Not finished until the closing brace
+	cmd_t cmd;
+	feed(&cmd, "{\"result\":\"ok\",\"cmd\":{\"ti\":30", 4);
+	CHECK(!cmd_done(&cmd));
+	cmd_feed(&cmd, "}}", 2);
+	CHECK(cmd_done(&cmd));
+	CHECK(has(&cmd, CMD_TRACKINTERVAL, 30));
+}
+
+static void testNesting(void)
+{
+	cmd_t cmd;
+
+	// Only keys directly inside the top level cmd object count
+	feed(&cmd,
+		"{\"x\":{\"ti\":99,\"cmd\":{\"ti\":98}},"
+		"\"result\":\"ok\","
+		"\"cmd\":{\"hb\":{\"ti\":7},\"a\":[1,2,{\"enc\":5},[3]],\"ti\":30,\"bal\":1},"
+		"\"enc\":4}",
+		3
+	);
+	CHECK(cmd_done(&cmd));
+	CHECK(cmd_resultOk(&cmd));
+	CHECK(has(&cmd, CMD_TRACKINTERVAL, 30));
+	CHECK(has(&cmd, CMD_BALANCE, 1));
+	CHECK(missing(&cmd, CMD_ENCODING));
+	CHECK(missing(&cmd, CMD_HEARTBEAT));
+
+	// Strings with braces, quotes and escapes in them
+	feed(&cmd, "{\"msg\":\"}{\\\"][,:\",\"result\":\"ok\",\"cmd\":{\"s\":\"\\\\\",\"hb\":2}}", 1);
+	CHECK(cmd_done(&cmd));
+	CHECK(cmd_resultOk(&cmd));
+	CHECK(has(&cmd, CMD_HEARTBEAT, 2));
+}
+
+static void testNumbers(void)
+{
+	cmd_t cmd;
+
+	feed(&cmd, "{\"result\":\"ok\",\"cmd\":{\"ti\":-20,\"hb\":0,\"enc\":-0,\"bal\":999999999,\"rs\":2147483648}}", 5);
+	CHECK(has(&cmd, CMD_TRACKINTERVAL, -20));
+	CHECK(has(&cmd, CMD_HEARTBEAT, 0));
+	CHECK(has(&cmd, CMD_ENCODING, 0));
+	CHECK(has(&cmd, CMD_BALANCE, 999999999));
+	CHECK(missing(&cmd, CMD_RESYNC)); // Too many digits
+
+	// Decimals keep the integer part, exponents are ignored
+	feed(&cmd, "{\"result\":\"ok\",\"cmd\":{\"ti\":1.5,\"hb\":-2.75,\"enc\":1e3,\"bal\":2E-1,\"rs\":3}}", 2);
+	CHECK(has(&cmd, CMD_TRACKINTERVAL, 1));
+	CHECK(has(&cmd, CMD_HEARTBEAT, -2));
+	CHECK(missing(&cmd, CMD_ENCODING));
+	CHECK(missing(&cmd, CMD_BALANCE));
+	CHECK(has(&cmd, CMD_RESYNC, 3));
+
+	// true/false/null aren't numbers
+	feed(&cmd, "{\"result\":\"ok\",\"cmd\":{\"ti\":true,\"bal\":null,\"hb\":5}}", 7);
+	CHECK(missing(&cmd, CMD_TRACKINTERVAL));
+	CHECK(missing(&cmd, CMD_BALANCE));
+	CHECK(has(&cmd, CMD_HEARTBEAT, 5));
+}
+
+static void testLongStrings(void)
+{
+	cmd_t cmd;
+
+	// Keys and values longer than CMD_STR_MAXLEN are treated as unknown, not truncated into something that matches
+	feed(&cmd, "{\"result\":\"ok\",\"cmd\":{\"tiiiiiiiiiiiiiiiiiii\":5,\"hbhbhbhbhb\":6,\"ti\":7}}", 1);
+	CHECK(cmd_resultOk(&cmd));
+	CHECK(has(&cmd, CMD_TRACKINTERVAL, 7));
+	CHECK(missing(&cmd, CMD_HEARTBEAT));
+
+	feed(&cmd, "{\"result\":\"okokokokokokokok\",\"cmd\":{\"ti\":7}}", 1);
+	CHECK(cmd_done(&cmd));
+	CHECK(!cmd_resultOk(&cmd));
+
+	// Exactly CMD_STR_MAXLEN is fine
+	feed(&cmd, "{\"padding\":\"12345678\",\"result\":\"ok\"}", 1);
+	CHECK(cmd_done(&cmd));
+	CHECK(cmd_resultOk(&cmd));
+}
+
+static void testErrors(void)
+{
+	cmd_t cmd;
+
+	// A bad result is final straight away
+	feed(&cmd, "{\"result\":\"error\",\"cmd\":{", 1);
+	CHECK(cmd_done(&cmd));
+	CHECK(!cmd_resultOk(&cmd));
+
+	// No JSON at all
+	feed(&cmd, "HTTP/1.1 500 Internal Server Error\r\n\r\n<html>", 3);
+	CHECK(!cmd_done(&cmd));
+	CHECK(!cmd_resultOk(&cmd));
+
+	// Anything after the end is ignored
+	feed(&cmd, "{\"result\":\"ok\"}{\"result\":\"error\",\"cmd\":{\"ti\":1}}", 4);
+	CHECK(cmd_done(&cmd));
+	CHECK(cmd_resultOk(&cmd));
+	CHECK(missing(&cmd, CMD_TRACKINTERVAL));
+}
+
+int main(void)
+{
+	testBasic();
+	testNesting();
+	testNumbers();
+	testLongStrings();
+	testErrors();
+
+	if(failures)
+	{
+		printf("cmd: %u failed\n", failures);
+		return 1;
+	}
+	printf("cmd: ok\n");
+	return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+#ifndef __COMMON_H_
+#define __COMMON_H_
+
+// Stands in for include/common.h when building modules on the host, just enough of the SDK for them to compile
+
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define PRINTD(fmt, ...)	do { if(0) printf(fmt, ## __VA_ARGS__); } while(0)
+
+// api_hal_i2c.h
+typedef enum {
+	I2C1 = 1,
+	I2C2,
+	I2C3
+} I2C_ID_t;
+
+typedef enum {
+	I2C_FREQ_100K = 100000,
+	I2C_FREQ_400K = 400000
+} I2C_FREQ_t;
+
+typedef struct {
+	I2C_FREQ_t freq;
+} I2C_Config_t;
+
+typedef enum {
+	I2C_ERROR_NONE = 0,
+	I2C_ERROR_RESOURCE_RESET,
+	I2C_ERROR_RESOURCE_BUSY,
+	I2C_ERROR_RESOURCE_TIMEOUT,
+	I2C_ERROR_RESOURCE_NOT_ENABLED,
+	I2C_ERROR_BAD_PARAMETER,
+	I2C_ERROR_COMMUNICATION_FAILED
+} I2C_Error_t;
+
+#define I2C_DEFAULT_TIME_OUT	10
+
+bool I2C_Init(I2C_ID_t id, I2C_Config_t config);
+I2C_Error_t I2C_Transmit(I2C_ID_t id, uint16_t slaveAddr, uint8_t* pData, uint16_t length, uint32_t timeOut);
+I2C_Error_t I2C_Receive(I2C_ID_t id, uint16_t slaveAddr, uint8_t* pData, uint16_t length, uint32_t timeOut);
+bool I2C_Close(I2C_ID_t id);
+
+#include "bme280.h"
+#include "cmd.h"
+
+#ifndef BME280_PROFILE
+#define BME280_PROFILE	BME280_PROFILE_WEATHER
+#endif
+
+#endif
@@ -17,6 +17,56 @@
 #define MAIL_COMM_DO				0x02
 #define MAIL_COMM_KEEPALIVE			0x03
 #define MAIL_COMM_POWEROFF			0x04
-#define MAIL_COMM_POWERCYCLE		0x05
+#define MAIL_COMM_HEARTBEAT			0x05 // Was POWERCYCLE, never implemented
+#define MAIL_COMM_BAUD				0x06
+#define MAIL_COMM_ECHO				0x07
+
+// MAIL_COMM_BAUD data is the baud rate index, the MCU replies with the same byte at the old rate and then switches
+// MAIL_COMM_ECHO data is sent back as-is, used for testing the link
+// MAIL_COMM_HEARTBEAT data is how many hours (1 - 31) to wait before waking up with nothing to do, 0 = disabled. No reply.
+// MAIL_COMM_POWEROFF data is the status (PWROFF_*), OR with MAIL_COMM_POWEROFF_GRACE to have the MCU wait a bit before cutting power.
+//   The A9G carries on disconnecting from the network during the grace period and sends a normal MAIL_COMM_POWEROFF when it's done to cut power straight away.
+// A MAIL_COMM_RESERVED (0x00) byte sent at 9600 will always cause a framing error at the faster rates, which makes the MCU fall back to 9600
+
+#define MAIL_COMM_POWEROFF_GRACE	0x04
+
+#define MAIL_COMM_BAUD_9600			0
+#define MAIL_COMM_BAUD_19200		1
+#define MAIL_COMM_BAUD_38400		2
+#define MAIL_COMM_BAUD_57600		3
+#define MAIL_COMM_BAUD_115200		4
+#define MAIL_COMM_BAUD_COUNT		5
+
+// Status frame sent by the MCU, either as a reply to MAIL_COMM_REQUEST or pushed unsolicited.
+// The MCU pushes the frame when the A9G is turned on and again whenever something changes,
+// repeating every second until the A9G replies with MAIL_COMM_KEEPALIVE.
+// Only the first frame of a session carries the wake reasons, later frames show reasons that will be handled on the next wake.
+// 16-bit values are MSB first.
+// The header data bits hold the frame version, the A9G ignores frames from a different version so both firmwares must be flashed from the same release.
+
+#define MAIL_COMM_FRAME_VERSION		1 // Bump whenever the frame layout changes, 0 = firmware from before the version was added
+
+#define MAIL_COMM_FRAME_HEADER		0 // MAIL_COMM_DO | MAIL_COMM_FRAME_VERSION<<3
+#define MAIL_COMM_FRAME_SUCCESS		1
+#define MAIL_COMM_FRAME_FAILURE		3
+#define MAIL_COMM_FRAME_TIMEOUT		5
+#define MAIL_COMM_FRAME_FLAGS		7
+#define MAIL_COMM_FRAME_MAILCOUNT	8 // Number of mail triggers merged into this wake
+#define MAIL_COMM_FRAME_MAILAGE		9 // Time since the first mail trigger of this wake (ticks, stops at 0xFFFE), MAIL_COMM_MAILAGE_NONE if there isn't one
+#define MAIL_COMM_FRAME_STUCKPOLLS	11 // Number of times the MCU has checked if a stuck mail switch has opened
+#define MAIL_COMM_FRAME_UPTIME		13 // Seconds since the MCU was reset (32-bit)
+#define MAIL_COMM_FRAME_CHECKSUM	17 // Sum of all previous bytes
+#define MAIL_COMM_FRAME_LEN			18
+
+#define MAIL_COMM_TICK_HZ			64 // MCU timebase
+#define MAIL_COMM_MAILAGE_NONE		0xFFFF
+
+#define MAIL_COMM_FLAG_SWITCHSTUCK	0
+#define MAIL_COMM_FLAG_TRACKMODE	1
+#define MAIL_COMM_FLAG_ENDCHARGING	2
+#define MAIL_COMM_FLAG_NEWMAIL		3
+#define MAIL_COMM_FLAG_VLM			4
+#define MAIL_COMM_FLAG_SMSBAL		5
+#define MAIL_COMM_FLAG_HEARTBEAT	6
 
 #endif
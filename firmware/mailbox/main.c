@@ -41,27 +41,42 @@
 #define VLOWBATT			3500
 #define VCHARGEDBATT		4050
 
-#define TIMEOUT				7500 // 2 mins
-#define TIMEOUT_KEEPALIVE	3750 // 60 seconds
+#define TIMEOUT				TMR_MS(120000) // 2 mins
+#define TIMEOUT_KEEPALIVE	TMR_MS(60000) // 60 seconds
 
 #define RETRY_COUNT			5
 
+#define POWEROFF_GRACE		3000 // Max time to wait for the A9G to disconnect from the network after it has sent its final status (ms)
+
+#define MAIL_COALESCE		5000 // How long to hold a mail trigger so more deliveries can be merged into the same wake (ms), 0 to disable
+
+#define STUCK_POLL_MIN		2 // How often to check if a stuck mail switch has opened, doubles after each check that finds it still stuck (seconds)
+#define STUCK_POLL_MAX		1024 // Ceiling for the above (seconds, max 32768)
+
 
 
 #define VREF_VAL			1100
 #define LOWBATT_VAL			(uint8_t)((((float)VREF_VAL / VLOWBATT) * 255.0) + 0.5)
 #define CHARGEDBATT_VAL		(uint8_t)((((float)VREF_VAL / VCHARGEDBATT) * 255.0) + 0.5)
 
-#define BAUD_VAL			(uint16_t)((64 * F_CPU) / (16 * BAUDRATE))
+#define BAUD_CALC(baud)		(uint16_t)((((float)64 * F_CPU) / (16 * (baud))) + 0.5)
+#define BAUD_VAL			BAUD_CALC(BAUDRATE)
 
-#define TMR_MS(ms)			((uint16_t)(((float)ms / 16) + 0.5)) // PIT increments every 16ms
+#define TICK_HZ				MAIL_COMM_TICK_HZ // RTC counter runs from the 1.024KHz ULP oscillator / 16
+#define TMR_MS(ms)			((uint32_t)(((float)(ms) * TICK_HZ / 1000) + 0.5))
+#define TMR_SEC(sec)		((uint32_t)(sec) * TICK_HZ)
 
 #define STATE_IDLE		0
 #define STATE_WAIT		1
 #define STATE_POWEROFF	2
 #define STATE_DELAY		3
 
-#define CMDDATA_BUFF	8
+#define CMDDATA_BUFF	MAIL_COMM_FRAME_LEN
+#define UARTRX_BUFF		4 // Must be a power of 2, the A9G sends a few single byte commands back to back (keepalive, heartbeat, baud)
+
+#define CMD_NONE		0xFF
+
+#define PUSH_INTERVAL	1000 // How often to repeat a status push until the A9G acknowledges it
 
 #define UART_DIR_RX	0
 #define UART_DIR_TX	1
@@ -87,28 +102,41 @@ typedef enum
 } trigChange_t;
 
 typedef struct {
-	uint8_t newMail;
+	uint8_t newMail; // Number of triggers
 	uint8_t trackMode;
 	uint8_t switchStuck;
 	uint8_t endCharging;
+	uint8_t heartbeat;
 } reasons_t;
 
 typedef struct {
 	trigState_t state;
-	uint16_t time;
+	uint32_t time;
 } trigger_t;
 
-static volatile uint16_t now;
+static volatile uint16_t rtcOverflows; // Upper 16 bits of the timebase, RTC.CNT is the lower 16
 static volatile uint8_t interrupt;
 static volatile uint8_t uartDirection;
-static volatile uint8_t uartData;
-static volatile uint8_t uartNewData;
+static volatile uint8_t uartData[UARTRX_BUFF];
+static volatile uint8_t uartHead; // Written by the RX ISR only
+static volatile uint8_t uartTail; // Written by the main loop only
 
 static volatile uint8_t cmdData[CMDDATA_BUFF];
 static volatile uint8_t cmdDataIdx;
+static volatile uint8_t cmdDataLen;
+static volatile uint16_t baudNext;
 
 static volatile uint8_t vlmDetected;
 
+// Indexed by MAIL_COMM_BAUD_*
+static const uint16_t baudVals[MAIL_COMM_BAUD_COUNT] = {
+	BAUD_CALC(9600UL),
+	BAUD_CALC(19200UL),
+	BAUD_CALC(38400UL),
+	BAUD_CALC(57600UL),
+	BAUD_CALC(115200UL)
+};
+
 static uint8_t mcusr_mirror __attribute__ ((section(".noinit,\"aw\",@nobits;"))); // BUG: https://github.com/qmk/qmk_firmware/issues/3657
 
 void get_mcusr(void) __attribute__ ((naked, used, section(".init3")));
@@ -118,7 +146,34 @@ void get_mcusr()
 	RSTCTRL.RSTFR = 0xFF;
 }
 
-static trigChange_t trig_process(trigger_t* trig, uint8_t in, uint16_t now)
+static uint8_t addSat(uint8_t a, uint8_t b)
+{
+	uint8_t res = a + b;
+	return (res < a) ? UINT8_MAX : res;
+}
+
+// Ticks since reset, carries on counting through all sleep modes
+// Wraps after ~2 years so always compare differences
+static uint32_t tick_now(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+	uint16_t cnt = RTC.CNT;
+	uint16_t ovf = rtcOverflows;
+	// Overflowed but the interrupt hasn't run yet
+	if((RTC.INTFLAGS & RTC_OVF_bm) && cnt < 0x8000)
+		ovf++;
+	SREG = sreg;
+	return ((uint32_t)ovf<<16) | cnt;
+}
+
+// A command is waiting and any reply to the last one has finished sending
+static uint8_t uart_ready(void)
+{
+	return (uartHead != uartTail && uartDirection == UART_DIR_RX && cmdDataIdx >= cmdDataLen);
+}
+
+static trigChange_t trig_process(trigger_t* trig, uint8_t in, uint32_t now)
 {
 	if(in)
 	{
@@ -127,7 +182,7 @@ static trigChange_t trig_process(trigger_t* trig, uint8_t in, uint16_t now)
 			trig->state = TRIG_WAITACTIVE;
 			trig->time = now;
 		}
-		else if(trig->state == TRIG_WAITACTIVE && (uint16_t)(now - trig->time) >= 32) // 500ms
+		else if(trig->state == TRIG_WAITACTIVE && (uint32_t)(now - trig->time) >= TMR_MS(500))
 		{
 			trig->state = TRIG_ACTIVE;
 			return TRIG_CHANGE_ACTIVE;
@@ -144,7 +199,7 @@ static trigChange_t trig_process(trigger_t* trig, uint8_t in, uint16_t now)
 			trig->state = TRIG_WAITDEACTIVE;
 			trig->time = now;
 		}
-		else if(trig->state == TRIG_WAITDEACTIVE && (uint16_t)(now - trig->time) >= 32) // 500ms
+		else if(trig->state == TRIG_WAITDEACTIVE && (uint32_t)(now - trig->time) >= TMR_MS(500))
 		{
 			trig->state = TRIG_IDLE;
 			return TRIG_CHANGE_DEACTIVE;
@@ -179,8 +234,16 @@ int main(void)
 	PORTA.PIN3CTRL = PORT_PULLUPEN_bm | PORT_ISC_BOTHEDGES_gc; // FALLING/RISING interrupt doesn't work in sleep mode for this pin
 	PORTA.PIN7CTRL = PORT_PULLUPEN_bm | PORT_ISC_BOTHEDGES_gc;
 
-	// PIT Timer
+	// RTC counter for the timebase, it can't run in power-down so standby is used instead
+	// Typical figures in the datasheet are the same for both, about 0.7uA at 3V, the 1.024kHz ULP is running for the PIT anyway
+	// Overflows every 1024 seconds
 	RTC.CLKSEL = RTC_CLKSEL0_bm;
+	while(RTC.STATUS & RTC_CTRLABUSY_bm);
+	RTC.INTCTRL = RTC_OVF_bm;
+	RTC.CTRLA = RTC_PRESCALER_DIV16_gc | RTC_RUNSTDBY_bm | RTC_RTCEN_bm;
+	while(RTC.STATUS & RTC_CTRLABUSY_bm);
+
+	// PIT Timer, wakes the main loop up every 16ms while things are going on
 	while(RTC.PITSTATUS & RTC_CTRLBUSY_bm);
 	RTC.PITINTCTRL = RTC_PI_bm;
 	while(RTC.PITSTATUS & RTC_CTRLBUSY_bm);
@@ -207,14 +270,16 @@ int main(void)
 		.newMail = 0,
 		.trackMode = 0,
 		.switchStuck = 0,
-		.endCharging = 0
+		.endCharging = 0,
+		.heartbeat = 0
 	};
 
 	reasons_t reasonsShadow = {
 		.newMail = 0,
 		.trackMode = 0,
 		.switchStuck = 0,
-		.endCharging = 0
+		.endCharging = 0,
+		.heartbeat = 0
 	};
 
 	uint16_t successCount = 0;
@@ -228,22 +293,36 @@ int main(void)
 
 	uint8_t state = STATE_IDLE;
 
-	uint16_t powerOnOffTime = 0;
+	uint32_t powerOnOffTime = 0;
 	uint8_t poweroffDelay = 0;
+	uint8_t poweroffGrace = 0;
+	uint32_t graceTime = 0;
 
-	uint16_t keepAliveTime = 0;
+	uint32_t keepAliveTime = 0;
 	
 	uint8_t switchStuck = 0;
 	uint8_t chargeComplete = 0;
 
-	uint16_t checkStuckTime = 0;
-	uint8_t forceCheckStuck = 0;
+	uint32_t checkStuckTime = 0;
+	uint16_t stuckInterval = STUCK_POLL_MIN; // Seconds
+	uint16_t stuckPolls = 0;
 	
 	uint8_t retryCount = 0;
-	uint16_t lastRetryTime = 0;
+	uint32_t lastRetryTime = 0;
 	
 	uint8_t clearVlmDetected = 0;
 
+	uint8_t statusSent = 0;
+	uint8_t statusFlags = 0;
+	uint8_t pushPending = 0;
+	uint32_t pushTime = 0;
+
+	uint32_t mailTime = 0;
+	uint32_t mailTimeShadow = 0; // mailTime of the reasons handed to the A9G, put back if it has to retry
+
+	uint8_t heartbeatHours = 0;
+	uint32_t heartbeatTime = 0;
+
 	uartDirection = UART_DIR_RX;
 
 	sei();
@@ -253,8 +332,8 @@ int main(void)
 		cli();
 		interrupt = 0;
 		uint8_t port = ~VPORTA.IN;
-		uint16_t tmpNow = now;
 		sei();
+		uint32_t tmpNow = tick_now();
 
 		// Button press
 		if(trig_process(&button, (port & PIN3_bm), tmpNow) == TRIG_CHANGE_ACTIVE)
@@ -280,19 +359,31 @@ int main(void)
 		}
 
 		// Mail trigger
+		// If a wake is already in progress and the status hasn't been sent yet then this will be merged into it
 		if(trig_process(&mail, (port & PIN2_bm), tmpNow) == TRIG_CHANGE_ACTIVE)
-			reasons.newMail = 1;
+		{
+			if(!reasons.newMail)
+				mailTime = tmpNow;
+			reasons.newMail = addSat(reasons.newMail, 1);
+		}
+
+		// Hold the first mail trigger for a few seconds in case the flap gets opened again
+		uint8_t mailHold = (
+			MAIL_COALESCE
+			&& reasons.newMail
+			&& (uint32_t)(tmpNow - mailTime) < TMR_MS(MAIL_COALESCE)
+		);
 
 		// Mail switch stuck
 		if(
 			(port & PIN2_bm) &&
 			mail.state == TRIG_ACTIVE &&
-			(uint16_t)(tmpNow - mail.time) >= TMR_MS(15000) // 15 seconds
+			(uint32_t)(tmpNow - mail.time) >= TMR_MS(15000) // 15 seconds
 		)
 		{
 			mail.state = TRIG_DISABLE;
 			checkStuckTime = tmpNow;
-			forceCheckStuck = 0;
+			stuckInterval = STUCK_POLL_MIN;
 			if(!switchStuck)
 				reasons.switchStuck = 1;
 			switchStuck = 1;
@@ -301,10 +392,12 @@ int main(void)
 		}
 
 		// Stuck switch stuff
-		if(switchStuck && (forceCheckStuck || (uint16_t)(tmpNow - checkStuckTime) >= TMR_MS(2000))) // 2 secs
+		// A parcel can jam the flap for days, so back off checking while it stays stuck
+		if(switchStuck && (uint32_t)(tmpNow - checkStuckTime) >= TMR_SEC(stuckInterval))
 		{
 			checkStuckTime = tmpNow;
-			forceCheckStuck = 0;
+			if(stuckPolls < UINT16_MAX)
+				stuckPolls++;
 
 			PORTA.PIN2CTRL |= PORT_PULLUPEN_bm;
 			VPORTA.DIR &= ~PIN2_bm;
@@ -323,14 +416,23 @@ int main(void)
 				switchStuck = 0;
 				PORTA.PIN2CTRL |= PORT_ISC_FALLING_gc;
 				mail.state = TRIG_IDLE;
+				stuckInterval = STUCK_POLL_MIN;
 			}
 			else // Still stuck
 			{
 				PORTA.PIN2CTRL &= ~PORT_PULLUPEN_bm;
 				VPORTA.DIR |= PIN2_bm;
+				stuckInterval = (stuckInterval >= STUCK_POLL_MAX / 2) ? STUCK_POLL_MAX : stuckInterval * 2;
 			}
 		}
 		
+		// Nothing has happened for a while, wake up anyway so the server knows we're still alive
+		if(heartbeatHours && (uint32_t)(tmpNow - heartbeatTime) >= TMR_SEC(heartbeatHours * 3600UL))
+		{
+			heartbeatTime = tmpNow;
+			reasons.heartbeat = 1;
+		}
+
 		//reasons.newMail = 1;
 
 		switch(state)
@@ -338,7 +440,7 @@ int main(void)
 			case STATE_DELAY:
 			
 				// After powring off the GSM module wait for at least 1 second so the capacitors and things discharge before turning it back on
-				if(poweroffDelay && (uint16_t)(tmpNow - powerOnOffTime) >= TMR_MS(1000))
+				if(poweroffDelay && (uint32_t)(tmpNow - powerOnOffTime) >= TMR_MS(1000))
 				{
 					poweroffDelay = 0;
 					if(retryCount == 0)
@@ -346,7 +448,7 @@ int main(void)
 				}
 
 				// Wait 5 seconds if we're doing a retry
-				if(retryCount > 0 && (uint16_t)(tmpNow - lastRetryTime) >= TMR_MS(5000))
+				if(retryCount > 0 && (uint32_t)(tmpNow - lastRetryTime) >= TMR_MS(5000))
 				{
 					if(!poweroffDelay)
 						state = STATE_IDLE;
@@ -360,7 +462,7 @@ int main(void)
 					if(!interrupt)
 					{
 						//BOD.CTRLA = BOD_ACTIVE_ENWAKE_gc | BOD_SLEEP_DIS_gc;
-						SLPCTRL.CTRLA = SLPCTRL_SMODE_PDOWN_gc | SLPCTRL_SEN_bm;
+						SLPCTRL.CTRLA = SLPCTRL_SMODE_STDBY_gc | SLPCTRL_SEN_bm;
 						sei();
 						sleep_cpu();
 						//BOD.CTRLA = BOD_ACTIVE_ENWAKE_gc | BOD_SLEEP_ENABLED_gc;
@@ -371,10 +473,25 @@ int main(void)
 				__attribute__ ((fallthrough));
 			case STATE_IDLE:
 				poweroffDelay = 0;
-				if(reasons.newMail == 0 && reasons.endCharging == 0 && reasons.trackMode == 0 && reasons.switchStuck == 0) // Nothing to do
+				if((reasons.newMail == 0 || mailHold) && reasons.endCharging == 0 && reasons.trackMode == 0 && reasons.switchStuck == 0 && reasons.heartbeat == 0) // Nothing to do (yet)
 				{
 					retryCount = 0;
 
+					// How long until the next stuck switch check or heartbeat
+					uint32_t sleepTime = UINT32_MAX;
+					if(switchStuck)
+					{
+						uint32_t elapsed = tmpNow - checkStuckTime;
+						sleepTime = (elapsed < TMR_SEC(stuckInterval)) ? TMR_SEC(stuckInterval) - elapsed : 0;
+					}
+					if(heartbeatHours)
+					{
+						uint32_t elapsed = tmpNow - heartbeatTime;
+						uint32_t remaining = (elapsed < TMR_SEC(heartbeatHours * 3600UL)) ? TMR_SEC(heartbeatHours * 3600UL) - elapsed : 0;
+						if(remaining < sleepTime)
+							sleepTime = remaining;
+					}
+
 					cli();
 					if(!interrupt)
 					{
@@ -384,18 +501,29 @@ int main(void)
 							&& button.state != TRIG_WAITDEACTIVE
 							&& charging.state != TRIG_WAITACTIVE
 							&& charging.state != TRIG_WAITDEACTIVE
+							&& !mailHold
+							&& sleepTime > TMR_MS(100) // Compare match might get missed if it's too close
 						);
 						
 						// Long sleep:
 						// Infinite if everything is ok (wake up by pin change interrupt)
-						// 32 seconds if switch is stuck (to see if its still stuck)
+						// Until the next stuck switch check or heartbeat is due (wake up by RTC compare match)
+						// The RTC overflow interrupt still runs every 1024 seconds to keep the timebase going, but doesn't wake the main loop
 
 						if(canDoLongSleep)
 						{
-							if(!switchStuck)
-								RTC.PITCTRLA = 0; // PIT off
-							else
-								RTC.PITCTRLA = RTC_PERIOD3_bm | RTC_PERIOD2_bm | RTC_PERIOD1_bm | RTC_PITEN_bm; // 32 seconds
+							RTC.PITCTRLA = 0; // PIT off
+
+							// Compare match can only reach 1024 seconds ahead, anything further away will have to go round the main loop and come back here
+							if(sleepTime != UINT32_MAX)
+							{
+								if(sleepTime > UINT16_MAX)
+									sleepTime = UINT16_MAX;
+								while(RTC.STATUS & RTC_CMPBUSY_bm);
+								RTC.CMP = (uint16_t)(tmpNow + sleepTime);
+								RTC.INTFLAGS = RTC_CMP_bm;
+								RTC.INTCTRL = RTC_OVF_bm | RTC_CMP_bm;
+							}
 
 							// RTC/PIT update takes around 3ms to complete
 							// Downclock CPU to save power
@@ -407,9 +535,16 @@ int main(void)
 						}
 
 						//BOD.CTRLA = BOD_ACTIVE_ENWAKE_gc | BOD_SLEEP_DIS_gc;
-						SLPCTRL.CTRLA = SLPCTRL_SMODE_PDOWN_gc | SLPCTRL_SEN_bm;
+						SLPCTRL.CTRLA = SLPCTRL_SMODE_STDBY_gc | SLPCTRL_SEN_bm;
+
+						// RTC overflows wake the CPU but don't set interrupt, go straight back to sleep
+						do
+						{
+							sei();
+							sleep_cpu();
+							cli();
+						} while(!interrupt);
 						sei();
-						sleep_cpu();
 						//BOD.CTRLA = BOD_ACTIVE_ENWAKE_gc | BOD_SLEEP_ENABLED_gc;
 
 						// Put PIT back to 16ms
@@ -426,11 +561,9 @@ int main(void)
 							CCP = CCP_IOREG_gc;
 							CLKCTRL.MCLKCTRLB = CLKCTRL_PDIV_6X_gc | CLKCTRL_PEN_bm;
 							sei();
-						}
 
-						// The stuck switch timer counter expects the timer to increment every 16ms, but we
-						// might have just woken up from a 32 second PIT, so set forceCheckStuck to make it check now
-						forceCheckStuck = 1;
+							RTC.INTCTRL = RTC_OVF_bm; // Might have been woken up by a pin change instead
+						}
 					}
 					sei();
 					break;
@@ -461,14 +594,20 @@ int main(void)
 						if(!vlmDetected)
 							clearVlmDetected = 1;
 						VPORTA.OUT &= ~PIN1_bm;
+						USART0.BAUD = BAUD_VAL; // A9G always starts at 9600
 						powerOnOffTime = tmpNow;
 						keepAliveTime = tmpNow;
-						uartNewData = 0;
+						uartTail = uartHead;
+						statusSent = 0;
+						pushPending = 1; // Keep pushing status until the A9G has booted and replies
+						pushTime = tmpNow;
 						state = STATE_WAIT;
 						reasonsShadow.newMail = 0;
 						reasonsShadow.endCharging = 0;
 						//reasonsShadow.trackMode = 0;
 						reasonsShadow.switchStuck = 0;
+						reasonsShadow.heartbeat = 0;
+						heartbeatTime = tmpNow;
 					}
 					else
 					{
@@ -477,13 +616,20 @@ int main(void)
 						reasons.endCharging = 0;
 						reasons.trackMode = 0;
 						reasons.switchStuck = 0;
+						reasons.heartbeat = 0;
 						retryCount = 0;
 						break;
 					}
 				}
 				__attribute__ ((fallthrough));
 			case STATE_WAIT:
-				if(!reasons.trackMode && (uint16_t)(tmpNow - powerOnOffTime) >= TIMEOUT)// || (uint16_t)(tmpNow - keepAliveTime) > TIMEOUT_KEEPALIVE) // TODO implement keep-alive stuff
+				if(poweroffGrace && (uint32_t)(tmpNow - graceTime) >= TMR_MS(POWEROFF_GRACE))
+				{
+					// A9G is taking too long to disconnect, the result has already been counted so just turn it off
+					poweroffGrace = 0;
+					state = STATE_POWEROFF;
+				}
+				else if(!poweroffGrace && !reasons.trackMode && (uint32_t)(tmpNow - powerOnOffTime) >= TIMEOUT)// || (uint32_t)(tmpNow - keepAliveTime) > TIMEOUT_KEEPALIVE) // TODO implement keep-alive stuff
 				{
 					// Module is taking too long doing stuff, force turn off and retry
 
@@ -494,10 +640,13 @@ int main(void)
 					retryCount++;
 					if(retryCount < RETRY_COUNT)
 					{
-						reasons.newMail |= reasonsShadow.newMail;
+						if(reasonsShadow.newMail) // Older than any trigger that came in during this wake
+							mailTime = mailTimeShadow;
+						reasons.newMail = addSat(reasons.newMail, reasonsShadow.newMail);
 						reasons.endCharging |= reasonsShadow.endCharging;
 						//reasons.trackMode |= reasonsShadow.trackMode;
 						reasons.switchStuck |= reasonsShadow.switchStuck;
+						reasons.heartbeat |= reasonsShadow.heartbeat;
 					}
 					else
 					{
@@ -507,6 +656,7 @@ int main(void)
 						reasons.endCharging = 0;
 						//reasons.trackMode = 0;
 						reasons.switchStuck = 0;
+						reasons.heartbeat = 0;
 					}
 					lastRetryTime = tmpNow;
 					
@@ -515,7 +665,7 @@ int main(void)
 				else
 				{
 					cli();
-					if(!uartNewData && !interrupt)
+					if(!uart_ready() && !interrupt)
 					{
 						if(uartDirection == UART_DIR_TX)// Idle sleep and wait for UART TX complete interrupt or PIT interrupt
 							SLPCTRL.CTRLA = SLPCTRL_SMODE_IDLE_gc | SLPCTRL_SEN_bm;
@@ -530,58 +680,150 @@ int main(void)
 					// When the A9G is first turned on the inrush current to all the capacitors causes the battery voltage to drop by around 0.8V, even with a soft-start thing in place.
 					// This might trigger the VLM thing, so clear it after ~500ms if it wasn't already set before powering on.
 					// Maybe I should make the soft-start even more fluffy u.u
-					if(clearVlmDetected && (uint16_t)(tmpNow - powerOnOffTime) >= TMR_MS(480))
+					if(clearVlmDetected && (uint32_t)(tmpNow - powerOnOffTime) >= TMR_MS(480))
 					{
 						vlmDetected = 0;
 						clearVlmDetected = 0;
 					}
 
+					uint8_t flags =
+						(smsBalanceGet == 0)<<MAIL_COMM_FLAG_SMSBAL |
+						vlmDetected<<MAIL_COMM_FLAG_VLM |
+						(reasons.newMail != 0)<<MAIL_COMM_FLAG_NEWMAIL |
+						reasons.endCharging<<MAIL_COMM_FLAG_ENDCHARGING |
+						reasons.trackMode<<MAIL_COMM_FLAG_TRACKMODE |
+						reasons.switchStuck<<MAIL_COMM_FLAG_SWITCHSTUCK |
+						reasons.heartbeat<<MAIL_COMM_FLAG_HEARTBEAT;
+
+					// Something changed since the last status was sent, push it to the A9G straight away
+					if(statusSent && !pushPending && flags != statusFlags)
+					{
+						pushPending = 1;
+						pushTime = tmpNow - TMR_MS(PUSH_INTERVAL);
+					}
+
 					// Commands processor
-					if(uartNewData)
+					uint8_t cmd = CMD_NONE;
+					uint8_t data = 0;
+					uint8_t isPush = 0;
+					if(uart_ready())
 					{
-						cli();
-						uint8_t data = uartData;
-						uartNewData = 0;
-						sei();
+						uint8_t tail = uartTail;
+						data = uartData[tail & (UARTRX_BUFF - 1)];
+						uartTail = tail + 1;
 
-						uint8_t cmd = data & 0x07;
+						cmd = data & 0x07;
 						data >>= 3;
+					}
+					else if(pushPending && uartDirection == UART_DIR_RX && (uint32_t)(tmpNow - pushTime) >= TMR_MS(PUSH_INTERVAL))
+					{
+						cmd = MAIL_COMM_REQUEST;
+						isPush = 1;
+						pushTime = tmpNow;
+					}
 
+					if(cmd != CMD_NONE)
+					{
 						//if(state == STATE_WAIT)// && uartDirection == UART_DIR_RX)
 						switch(cmd)
 						{
 							case MAIL_COMM_REQUEST:
-								cmdData[0] = MAIL_COMM_DO;
-								cmdData[1] = successCount>>8;
-								cmdData[2] = successCount;
-								cmdData[3] = failureCount>>8;
-								cmdData[4] = failureCount;
-								cmdData[5] = timeoutCount>>8;
-								cmdData[6] = timeoutCount;
-								cmdData[7] = (smsBalanceGet == 0)<<5 | vlmDetected<<4 | reasons.newMail<<3 | reasons.endCharging<<2 | reasons.trackMode<<1 | reasons.switchStuck;
+							{
+								cmdData[MAIL_COMM_FRAME_HEADER] = MAIL_COMM_DO | MAIL_COMM_FRAME_VERSION<<3;
+								cmdData[MAIL_COMM_FRAME_SUCCESS] = successCount>>8;
+								cmdData[MAIL_COMM_FRAME_SUCCESS + 1] = successCount;
+								cmdData[MAIL_COMM_FRAME_FAILURE] = failureCount>>8;
+								cmdData[MAIL_COMM_FRAME_FAILURE + 1] = failureCount;
+								cmdData[MAIL_COMM_FRAME_TIMEOUT] = timeoutCount>>8;
+								cmdData[MAIL_COMM_FRAME_TIMEOUT + 1] = timeoutCount;
+								cmdData[MAIL_COMM_FRAME_FLAGS] = flags;
+								cmdData[MAIL_COMM_FRAME_MAILCOUNT] = statusSent ? 0 : reasons.newMail;
+								uint16_t mailAge = MAIL_COMM_MAILAGE_NONE;
+								if(!statusSent && reasons.newMail)
+								{
+									uint32_t age = tmpNow - mailTime;
+									mailAge = (age >= MAIL_COMM_MAILAGE_NONE) ? MAIL_COMM_MAILAGE_NONE - 1 : age;
+								}
+								cmdData[MAIL_COMM_FRAME_MAILAGE] = mailAge>>8;
+								cmdData[MAIL_COMM_FRAME_MAILAGE + 1] = mailAge;
+								cmdData[MAIL_COMM_FRAME_STUCKPOLLS] = stuckPolls>>8;
+								cmdData[MAIL_COMM_FRAME_STUCKPOLLS + 1] = stuckPolls;
+								uint32_t uptime = tmpNow / TICK_HZ;
+								cmdData[MAIL_COMM_FRAME_UPTIME] = uptime>>24;
+								cmdData[MAIL_COMM_FRAME_UPTIME + 1] = uptime>>16;
+								cmdData[MAIL_COMM_FRAME_UPTIME + 2] = uptime>>8;
+								cmdData[MAIL_COMM_FRAME_UPTIME + 3] = uptime;
+								uint8_t sum = 0;
+								for(uint8_t i=0;i<MAIL_COMM_FRAME_CHECKSUM;i++)
+									sum += cmdData[i];
+								cmdData[MAIL_COMM_FRAME_CHECKSUM] = sum;
 								cmdDataIdx = 0;
+								cmdDataLen = CMDDATA_BUFF;
 								USART0.CTRLA |= USART_DREIE_bm;
-								reasonsShadow.newMail = reasons.newMail;
-								reasonsShadow.endCharging = reasons.endCharging;
-								//reasonsShadow.trackMode = reasons.trackMode;
-								reasonsShadow.switchStuck = reasons.switchStuck;
-								reasons.newMail = 0;
-								reasons.endCharging = 0;
-								//reasons.trackMode = 0;
-								reasons.switchStuck = 0;
-								//break;
+
+								// Only the first status of the session takes the reasons, anything that happens after will be sent on the next wake
+								if(!statusSent)
+								{
+									reasonsShadow.newMail = reasons.newMail;
+									mailTimeShadow = mailTime;
+									reasonsShadow.endCharging = reasons.endCharging;
+									//reasonsShadow.trackMode = reasons.trackMode;
+									reasonsShadow.switchStuck = reasons.switchStuck;
+									reasonsShadow.heartbeat = reasons.heartbeat;
+									reasons.newMail = 0;
+									reasons.endCharging = 0;
+									//reasons.trackMode = 0;
+									reasons.switchStuck = 0;
+									reasons.heartbeat = 0;
+									flags &= ~(1<<MAIL_COMM_FLAG_NEWMAIL | 1<<MAIL_COMM_FLAG_ENDCHARGING | 1<<MAIL_COMM_FLAG_SWITCHSTUCK | 1<<MAIL_COMM_FLAG_HEARTBEAT);
+								}
+								statusSent = 1;
+								statusFlags = flags;
+								if(isPush) // Wait for the keep-alive
+									break;
+							}
 								__attribute__ ((fallthrough));
 							case MAIL_COMM_KEEPALIVE:
 								keepAliveTime = tmpNow;
+								pushPending = 0;
+								break;
+							case MAIL_COMM_RESERVED: // Link reset from the A9G, the framing error would have already put us back to 9600
+								break;
+							case MAIL_COMM_BAUD:
+								// Reply at the current rate, switch to the new rate once the reply has finished sending
+								if(data < MAIL_COMM_BAUD_COUNT)
+								{
+									cmdData[0] = (data<<3) | MAIL_COMM_BAUD;
+									cmdDataIdx = 0;
+									cmdDataLen = 1;
+									baudNext = baudVals[data];
+									USART0.CTRLA |= USART_DREIE_bm;
+								}
+								break;
+							case MAIL_COMM_HEARTBEAT:
+								heartbeatHours = data;
+								break;
+							case MAIL_COMM_ECHO:
+								cmdData[0] = (data<<3) | MAIL_COMM_ECHO;
+								cmdDataIdx = 0;
+								cmdDataLen = 1;
+								USART0.CTRLA |= USART_DREIE_bm;
 								break;
 							case MAIL_COMM_POWEROFF:
-								if(data == PWROFF_SUCCESS)
+								if(poweroffGrace) // Already counted, A9G has finished disconnecting
+								{
+									poweroffGrace = 0;
+									state = STATE_POWEROFF;
+									break;
+								}
+
+								if((data & ~MAIL_COMM_POWEROFF_GRACE) == PWROFF_SUCCESS)
 								{
 									if(successCount < UINT16_MAX)
 										successCount++;
 
 									// Only get balance once every 10 wakes
-									// This saves ~8 seconds, increasing battery life
+									// The A9G checks it alongside the report so it doesn't hold things up much now, but the reply can keep the A9G on for a few more seconds
 									smsBalanceGet++;
 									if(smsBalanceGet >= 10)
 										smsBalanceGet = 0;
@@ -598,10 +840,13 @@ int main(void)
 
 									if(retryCount < RETRY_COUNT)
 									{
-										reasons.newMail |= reasonsShadow.newMail;
+										if(reasonsShadow.newMail)
+											mailTime = mailTimeShadow;
+										reasons.newMail = addSat(reasons.newMail, reasonsShadow.newMail);
 										reasons.endCharging |= reasonsShadow.endCharging;
 										//reasons.trackMode |= reasonsShadow.trackMode;
 										reasons.switchStuck |= reasonsShadow.switchStuck;
+										reasons.heartbeat |= reasonsShadow.heartbeat;
 									}
 									else
 									{
@@ -611,16 +856,25 @@ int main(void)
 										reasons.endCharging = 0;
 										//reasons.trackMode = 0;
 										reasons.switchStuck = 0;
+										reasons.heartbeat = 0;
 									}
 									lastRetryTime = tmpNow;
 								}
-								state = STATE_POWEROFF;
+
+								if(data & MAIL_COMM_POWEROFF_GRACE)
+								{
+									poweroffGrace = 1;
+									graceTime = tmpNow;
+								}
+								else
+									state = STATE_POWEROFF;
 								break;
 							default:
 								memset((uint8_t*)cmdData, '?', CMDDATA_BUFF);
 								cmdData[1] = cmd;
 								cmdData[2] = data;
 								cmdDataIdx = 0;
+								cmdDataLen = CMDDATA_BUFF;
 								USART0.CTRLA |= USART_DREIE_bm;
 								break;
 						}
@@ -649,42 +903,70 @@ ISR(PORTA_PORT_vect)
 
 ISR(USART0_RXC_vect)
 {
+	uint8_t status = USART0.RXDATAH; // Must be read before RXDATAL
 	uint8_t data = USART0.RXDATAL;
-	if(uartDirection == UART_DIR_RX)
+	if(status & USART_FERR_bm)
 	{
-		uartData = data;
-		uartNewData = 1;
+		// Probably a baud rate mismatch, fall back to 9600
+		USART0.BAUD = BAUD_VAL;
+		baudNext = 0;
+	}
+	else if(uartDirection == UART_DIR_RX)
+	{
+		uint8_t head = uartHead;
+		if((uint8_t)(head - uartTail) < UARTRX_BUFF) // Full, drop it. The A9G will ask again or time out
+		{
+			uartData[head & (UARTRX_BUFF - 1)] = data;
+			uartHead = head + 1;
+		}
 	}
 }
 
 ISR(USART0_TXC_vect)
 {
 	USART0.STATUS = USART_TXCIF_bm; // NOTE: This is not automatically cleared in loopback/one-wire mode!
-	if(cmdDataIdx >= CMDDATA_BUFF)
+	if(cmdDataIdx >= cmdDataLen)
 	{
 		uartDirection = UART_DIR_RX;
+		if(baudNext)
+		{
+			USART0.BAUD = baudNext;
+			baudNext = 0;
+		}
 	}
 }
 
 ISR(USART0_DRE_vect)
 {
-	if(cmdDataIdx < CMDDATA_BUFF)
+	if(cmdDataIdx < cmdDataLen)
 	{
 		uartDirection = UART_DIR_TX;
 		USART0.TXDATAL = cmdData[cmdDataIdx];
 		cmdDataIdx++;
 
-		if(cmdDataIdx >= CMDDATA_BUFF)
+		if(cmdDataIdx >= cmdDataLen)
 			USART0.CTRLA &= ~USART_DREIE_bm;
 	}
 	//else
 	//	USART0.CTRLA &= ~USART_DREIE_bm;
 }
 
+ISR(RTC_CNT_vect)
+{
+	uint8_t flags = RTC.INTFLAGS & RTC.INTCTRL; // CMP flag still gets set when its interrupt is off
+	RTC.INTFLAGS = flags;
+	if(flags & RTC_OVF_bm)
+		++rtcOverflows;
+	if(flags & RTC_CMP_bm)
+	{
+		RTC.INTCTRL = RTC_OVF_bm;
+		interrupt = 1;
+	}
+}
+
 ISR(RTC_PIT_vect)
 {
 	RTC.PITINTFLAGS = RTC_PI_bm;
-	++now;
 	interrupt = 1;
 }
 
@@ -0,0 +1,71 @@
+<?php
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+	// Trigger to notify latency for each mailbox, from the samples mailnotifier.php keeps in $stateDir
+	// total = Flap opening to Telegram accepting the message
+	// device = Flap opening to the report being built (MCU wake, A9G boot, network registration etc)
+	// upload = Report being built to it arriving here, compares the mailbox's network clock with ours so it's only good to about a second
+	// server = Report arriving to Telegram accepting the message
+	// All in ms. Samples where the mailbox didn't know the time have no upload, they're left out of upload and total
+
+	$stateDir = 'state/'; // Same as mailnotifier.php
+
+	header('Content-Type: application/json');
+
+	// Nearest-rank percentile
+	function percentile($sorted, $p)
+	{
+		$idx = (int)ceil(($p / 100) * count($sorted)) - 1;
+		return $sorted[max($idx, 0)];
+	}
+
+	function summary($values)
+	{
+		sort($values);
+		return [
+			'p50' => percentile($values, 50),
+			'p95' => percentile($values, 95),
+			'p99' => percentile($values, 99)
+		];
+	}
+
+	$result = [];
+	foreach(glob($stateDir . '*-latency.json') as $latencyFile)
+	{
+		$samples = json_decode(file_get_contents($latencyFile), true);
+		if(!is_array($samples) || !count($samples))
+			continue;
+
+		$total = [];
+		$device = [];
+		$upload = [];
+		$server = [];
+		foreach($samples as $sample)
+		{
+			$device[] = $sample['device'];
+			$server[] = $sample['server'];
+			if(isset($sample['upload']) && $sample['upload'] >= 0)
+			{
+				$upload[] = $sample['upload'];
+				$total[] = $sample['device'] + $sample['upload'] + $sample['server'];
+			}
+		}
+
+		$imei = basename($latencyFile, '-latency.json');
+		$result[$imei] = [
+			'count' => count($samples),
+			'since' => gmdate('Y-m-d H:i:s', $samples[0]['time']),
+			'total' => count($total) ? summary($total) : null,
+			'device' => summary($device),
+			'upload' => count($upload) ? summary($upload) : null,
+			'server' => summary($server)
+		];
+	}
+
+	echo json_encode($result);
@@ -15,10 +15,13 @@
 		$keys = array_keys($arr2);
 		foreach($keys as $key)
 		{
+			// JSON arrays (track points etc) replace the old one instead of being merged by index
 			if(
 				isset($arr1[$key]) &&
 				is_array($arr1[$key]) &&
-				is_array($arr2[$key])
+				is_array($arr2[$key]) &&
+				count($arr2[$key]) &&
+				array_keys($arr2[$key]) !== range(0, count($arr2[$key]) - 1)
 			)
 				$arr1[$key] = my_merge($arr1[$key], $arr2[$key]);
 			else
@@ -39,9 +42,33 @@
 	// Most web hosts probably won't allow spawning processes
 	$fastResponse = false;
 
+	// Delta reports, the mailbox leaves out anything that hasn't changed since a report we've acknowledged (see DELTA_REPORTS in config.h)
+	// The last few reports from each mailbox are kept here so the next one can be merged over the one it was based on
+	// If we don't have it (state deleted, mailbox swapped etc) the mailbox is told to send everything next time
+	$stateDir = 'state/'; // Make sure it exists and is writable
+	$stateKeep = 8;
+
+	// Flap opening to Telegram accepting the message, the last this many samples are kept for each mailbox in $stateDir for latency.php
+	// Only measured when $fastResponse is off since that's the only way we know when Telegram got it
+	$latencyKeep = 500; // 0 to disable
+
 	$TG_TOKEN = '000000000:xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx'; // Telegram bot token
 	$TG_CHATID = '-0000000000000'; // Group chat ID
 
+	// Commands sent back to the mailbox in the response, it saves them to flash so they only need to be sent once
+	// Leave out anything that shouldn't be changed
+	// ti = GPS tracking report interval (seconds, 10 - 3600)
+	// bal = Check the SIM balance on the next wake (1)
+	// enc = Report encoding (0 = full, 1 = compact, leaves out firmware/power/timing and most of the network info)
+	// hb = Heartbeat, wake up and report every this many hours even if nothing happened (1 - 31, 0 = disabled)
+	// rs = Resync, added automatically when a delta report can't be merged
+	$DEVICE_COMMANDS = [
+		//'ti' => 60,
+		//'bal' => 1,
+		//'enc' => 0,
+		//'hb' => 24,
+	];
+
 	date_default_timezone_set('Etc/UTC');
 
 	// Blank out headers to reduce response size
@@ -49,7 +76,11 @@
 	header('Content-Type: ');
 	header('Server: ');
 
-	$jsonIn = file_get_contents($jsonSourceDebug ? 'test.json' : 'php://input');
+	// smsgateway.php sets $jsonInOverride with the JSON it built from an SMS and then includes this file
+	if(isset($jsonInOverride))
+		$jsonIn = $jsonInOverride;
+	else
+		$jsonIn = file_get_contents($jsonSourceDebug ? 'test.json' : 'php://input');
 	$jsonLength = strlen($jsonIn);
 	if(!$jsonLength || $jsonLength > 4096)
 		die('{"result":"error"}');
@@ -77,8 +108,45 @@
 			die('{"result":"error"}');
 		}
 
+		// Delta report, start from the report it was based on instead of just the defaults
+		$states = null;
+		if(isset($json2['delta']['base']) && isset($json2['delta']['seq']) && isset($json2['network']['imei']))
+		{
+			$stateFile = $stateDir . preg_replace('/[^0-9]/', '', $json2['network']['imei']) . '.json';
+			$states = is_file($stateFile) ? json_decode(file_get_contents($stateFile), true) : [];
+			if(!is_array($states))
+				$states = [];
+
+			$base = (int)$json2['delta']['base'];
+			if($base != 0)
+			{
+				if(isset($states[$base]))
+					$json1 = my_merge($json1, $states[$base]);
+				else // Missing bits will just be the defaults this time
+				{
+					$DEVICE_COMMANDS['rs'] = 1;
+					$states = null;
+				}
+			}
+		}
+
 		$res = my_merge($json1, $json2);
 		$obj = json_decode(json_encode($res));
+
+		if($states !== null)
+		{
+			// Move to the end so the oldest ones get dropped first
+			$seq = (int)$json2['delta']['seq'];
+			unset($states[$seq]);
+			unset($res['key']);
+			$states[$seq] = $res;
+
+			// Hang on to the one this report was based on, the mailbox keeps using it until something changes
+			$keep = array_slice($states, -$stateKeep, null, true);
+			if($base != 0 && !isset($keep[$base]))
+				$keep = [$base => $states[$base]] + $keep;
+			file_put_contents($stateFile, json_encode($keep), LOCK_EX);
+		}
 	}
 
 	if($obj === null)
@@ -88,8 +156,9 @@
 	if($obj->reasons->newmail)
 	{
 		$msgData[] = [
-			"%s *You have mail!*\n",
-			"\xF0\x9F\x93\xA8"
+			"%s *You have mail!*%s\n",
+			"\xF0\x9F\x93\xA8",
+			($obj->reasons->mailcount > 1) ? sprintf(' (%u items)', $obj->reasons->mailcount) : ''
 		];
 	}
 	if($obj->reasons->endcharge)
@@ -113,6 +182,20 @@
 			"\xE2\x9A\xA0"
 		];
 	}
+	if($obj->reasons->heartbeat)
+	{
+		$msgData[] = [
+			"%s _Heartbeat_\n",
+			"\xF0\x9F\x92\x93"
+		];
+	}
+	if($obj->transport == 'sms')
+	{
+		$msgData[] = [
+			"%s _Sent by SMS, GPRS failed_\n",
+			"\xE2\x9C\x89"
+		];
+	}
 	$msgData[] = [
 		"\n",
 	];
@@ -153,7 +236,7 @@
 		$obj->environment->humidity,
 		$obj->environment->pressure
 	];
-	if($obj->reasons->newmail || $obj->reasons->endcharge || $obj->reasons->switchstuck)
+	if($obj->reasons->newmail || $obj->reasons->endcharge || $obj->reasons->switchstuck || $obj->reasons->heartbeat)
 	{
 		$msgData[] = [
 			"Success: *%u*\n",
@@ -167,12 +250,26 @@
 			"Timeout: *%u*\n",
 			$obj->counts->timeout
 		];
+		if($obj->counts->stuckpolls)
+		{
+			$msgData[] = [
+				"Stuck switch checks: *%u*\n",
+				$obj->counts->stuckpolls
+			];
+		}
+	}
+	if($obj->balance->state == 3) // PAYG balance, check is running alongside the report and the reply hasn't arrived yet (it'll be in the next report)
+	{
+		$msgData[] = [
+			"_Balance pending_\n"
+		];
 	}
-	if($obj->balance->state != 0) // PAYG balance
+	else if($obj->balance->state != 0)
 	{
 		$msgData[] = [
-			"%s\n",
-			strlen($obj->balance->message) ? $obj->balance->message : '_Unknown balance_'
+			"%s%s\n",
+			strlen($obj->balance->message) ? $obj->balance->message : '_Unknown balance_',
+			($obj->balance->state == 4) ? ' _(late)_' : ''
 		];
 	}
 	if($obj->reasons->trackmode)
@@ -258,6 +355,17 @@
 			"Altitude: *%.2f m*\n",
 			$obj->track->altitude
 		];
+		$msgData[] = [ // How old the position is and how much of the time the GPS has been powered (duty cycling)
+			"Fix age: *%s* / GPS on: *%u%%*\n",
+			($obj->track->fixage < 0) ? 'None' : sprintf('%.1fs', $obj->track->fixage / 1000),
+			$obj->track->gpson
+		];
+		$msgData[] = [ // Simplified track points in this report, $obj->track->points is [lat * 100000, lon * 100000, age in seconds or -1 if unknown]
+			"Track points: *%u* (kept %u of %u fixes)\n",
+			count($obj->track->points),
+			$obj->track->ptsout,
+			$obj->track->ptsin
+		];
 		$msgData[] = [ // Number of satellites in view and tracking
 			"Satellites: *%u/%u* -> GPS: *%u%s/%u* / BDS: *%u%s/%u*\n",
 			$obj->track->sattrack,
@@ -340,6 +448,9 @@
 		curl_setopt($ch, CURLOPT_POSTFIELDS, $tgJsonDataEncoded);
 		curl_setopt($ch, CURLOPT_HTTPHEADER, array('Content-Type: application/json')); 
 		$tgResponse = curl_exec($ch);
+		$tgAck = json_decode($tgResponse, true);
+		if(isset($tgAck['ok']) && $tgAck['ok'])
+			$tgAckTime = microtime(true);
 		//echo $tgResponse;
 		
 		if($obj->reasons->trackmode)
@@ -349,4 +460,37 @@
 		}
 	}
 
-	echo '{"result":"ok"}';
+	// Record the trigger to notify latency
+	// device covers the flap opening to the report being built, timed by the mailbox alone
+	// upload is the report being built to it arriving here, from the mailbox's network clock (mailtime, whole seconds) against ours so it's only good to a second or so, -1 if the mailbox didn't know the time
+	if(
+		$latencyKeep &&
+		isset($tgAckTime) &&
+		$obj->reasons->newmail &&
+		$obj->reasons->mailage >= 0 &&
+		$obj->network->imei != ''
+	)
+	{
+		$latencyFile = $stateDir . preg_replace('/[^0-9]/', '', $obj->network->imei) . '-latency.json';
+		$samples = is_file($latencyFile) ? json_decode(file_get_contents($latencyFile), true) : [];
+		if(!is_array($samples))
+			$samples = [];
+
+		$arrival = $_SERVER['REQUEST_TIME_FLOAT'];
+		$upload = -1;
+		if($obj->reasons->mailtime > 0)
+			$upload = max((int)round(($arrival - $obj->reasons->mailtime) * 1000) - (int)$obj->reasons->mailage, 0);
+		$samples[] = [
+			'time' => (int)$arrival,
+			'device' => (int)$obj->reasons->mailage,
+			'upload' => $upload,
+			'server' => (int)round(($tgAckTime - $arrival) * 1000)
+		];
+		file_put_contents($latencyFile, json_encode(array_slice($samples, -$latencyKeep)), LOCK_EX);
+	}
+
+	// Nothing to send commands to if the report came in by SMS
+	if(count($DEVICE_COMMANDS) && $obj->transport == 'http')
+		echo json_encode(['result' => 'ok', 'cmd' => $DEVICE_COMMANDS]);
+	else
+		echo '{"result":"ok"}';
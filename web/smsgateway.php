@@ -0,0 +1,77 @@
+<?php
+/*
+ * Project: Remote Mail Notifier (and GPS Tracker)
+ * Author: Zak Kemble, contact@zakkemble.net
+ * Copyright: (C) 2020 by Zak Kemble
+ * License: 
+ * Web: https://blog.zakkemble.net/remote-mail-notifier-and-gps-tracker/
+ */
+
+	// SMS fallback ingest
+	// When GPRS fails the mailbox sends a compact SMS to SMS_FALLBACK_NUM instead.
+	// Point your SMS gateway (an Android SMS forwarding app, Twilio webhook etc) at this script, it should POST:
+	// token = $SMS_GATEWAY_TOKEN
+	// from = Sender number
+	// text = Message content
+	// The message is turned into the same JSON as the HTTP report and passed to mailnotifier.php.
+
+	// Message format: MN1 nm=1 mc=3 ec=0 ss=0 hb=0 bv=3978 bp=72 vl=0 cs=23 cf=0 ct=0 sg=4
+
+	$SMS_GATEWAY_TOKEN = 'xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx'; // Shared secret with the gateway
+	$SMS_ALLOWED_NUMBERS = ['+447000000000']; // The mailbox SIM number(s)
+
+	if(
+		!isset($_POST['token']) ||
+		!isset($_POST['from']) ||
+		!isset($_POST['text']) ||
+		!hash_equals($SMS_GATEWAY_TOKEN, $_POST['token']) ||
+		!in_array($_POST['from'], $SMS_ALLOWED_NUMBERS, true)
+	)
+		die('{"result":"error"}');
+
+	$parts = explode(' ', trim($_POST['text']));
+	if(array_shift($parts) !== 'MN1')
+		die('{"result":"error"}');
+
+	$fields = [];
+	foreach($parts as $part)
+	{
+		$kv = explode('=', $part, 2);
+		if(count($kv) == 2 && ctype_digit($kv[1]))
+			$fields[$kv[0]] = (int)$kv[1];
+	}
+
+	function field($fields, $key)
+	{
+		return isset($fields[$key]) ? $fields[$key] : 0;
+	}
+
+	// Only the fields that are in the SMS, mailnotifier.php fills in the rest from default.json
+	$json = [
+		'transport' => 'sms',
+		'network' => [
+			'signal' => field($fields, 'sg'),
+			'number' => $_POST['from']
+		],
+		'battery' => [
+			'voltage' => field($fields, 'bv'),
+			'percent' => field($fields, 'bp'),
+			'vlm' => field($fields, 'vl')
+		],
+		'reasons' => [
+			'newmail' => field($fields, 'nm'),
+			'mailcount' => field($fields, 'mc'),
+			'endcharge' => field($fields, 'ec'),
+			'trackmode' => 0,
+			'switchstuck' => field($fields, 'ss'),
+			'heartbeat' => field($fields, 'hb')
+		],
+		'counts' => [
+			'success' => field($fields, 'cs'),
+			'failure' => field($fields, 'cf'),
+			'timeout' => field($fields, 'ct')
+		]
+	];
+
+	$jsonInOverride = json_encode($json);
+	include 'mailnotifier.php';